@@ -1,434 +1,2055 @@
-#include "InterruptButton.h"
-
-// Include reference req'd for debugging and warnings across serial port.
-#ifdef ARDUINO
-#include "esp32-hal-log.h"
-#else
-#include "esp_log.h"
-#endif
-
-
-#define ESP_INTR_FLAG_DEFAULT   0
-#define EVENT_TASK_PRIORITY     2             // One level higher than arduino's loop() which is priority level 1
-#define EVENT_TASK_STACK        4096          // Stack size associated with the queue servicer 
-#define EVENT_TASK_NAME         "BTN_ACTN"
-#define EVENT_TASK_CORE         1             // Same core as setup() and loop()
-
-static const char* TAG = "IBTN";              // IDF log tag
-
-
-
-/* ToDo
-  1. Need to confirm if any ISR's need to blocked/disabled from other ISR entry, ie portMUX highlevel/lowlevel, etc.
-  2. Consider Adding button eventTypes such as momentary, latching, etc.
-  3. Consider adding chord combinations (2 or more buttons pressed concurently) as a event.  Added to static class member, when any one button is pushed.
-  corresponding buttons are checked to see if they are in waiting for release state (will be a factorial type check to minimise redundant checks)
-
-  4. Consider allowing a single button to follow it's own menu level and depart from the global menulevel.
-  This would be usefull when you have a powerbutton that doesn't change function and menu buttons that do
-  change their function based on what the current gui menu level is (like a soft key)
-*/
-
-//-- STATIC CLASS MEMBERS AND METHODS (COMMON ACROSS ALL INSTANCES TO SAVE MEMORY) -----------------------
-//--------------------------------------------------------------------------------------------------------
-//--------------------------------------------------------------------------------------------------------
-//--------------------------------------------------------------------------------------------------------
-
-//-- Initialise Static Member Variables ------------------------------------------------------------------
-//--------------------------------------------------------------------------------------------------------
-uint32_t      InterruptButton::m_RTOSservicerStackDepth                     { 2048 };
-uint8_t       InterruptButton::m_numMenus                                   { 0 };  // 0 Means not initialised, can be set by user; once set it can't be changed.
-uint8_t       InterruptButton::m_menuLevel                                  { 0 };
-modes         InterruptButton::m_mode                                       { Mode_Asynchronous };
-bool          InterruptButton::m_classInitialised                           { false };
-func_ptr_t    InterruptButton::m_asyncEventQueue[ASYNC_EVENT_QUEUE_DEPTH] = { nullptr };
-func_ptr_t    InterruptButton::m_syncEventQueue[SYNC_EVENT_QUEUE_DEPTH] =   { nullptr };
-TaskHandle_t  InterruptButton::m_asyncQueueServicerHandle                   { nullptr };
-bool          InterruptButton::m_deleteInProgress                           { false };
-
-// This is used to initialise the queue(s) and also switch between them.
-bool InterruptButton::setMode(modes mode){
-  // Flush both queues
-  for(uint8_t i = 0; i < ASYNC_EVENT_QUEUE_DEPTH; i++) m_asyncEventQueue[i] = nullptr;
-  for(uint8_t i = 0; i < SYNC_EVENT_QUEUE_DEPTH;  i++) m_syncEventQueue[i]  = nullptr;
-  
-  if(mode == Mode_Asynchronous || mode == Mode_Hybrid) {
-    m_mode = mode;
-
-    // Start the RTOS queue action service/task
-    bool retVal;
-    if(m_asyncQueueServicerHandle != nullptr) {
-      vTaskResume(m_asyncQueueServicerHandle);   // Assuming it may have been paused earlier.
-      retVal = true;
-    } else {
-      retVal = xTaskCreatePinnedToCore(asyncQueueServicer, EVENT_TASK_NAME, m_RTOSservicerStackDepth, NULL, 
-                                       EVENT_TASK_PRIORITY, &m_asyncQueueServicerHandle, EVENT_TASK_CORE) == pdPASS;
-    }
-    if(!retVal) ESP_LOGE(TAG, "setMode(): Failed to create RTOS queue servicing task!");
-    return retVal;
-
-  } else if(mode == Mode_Synchronous) {
-    m_mode = mode;
-    if(m_asyncQueueServicerHandle != nullptr)  vTaskSuspend(m_asyncQueueServicerHandle);
-    return true;
-
-  } else {
-    ESP_LOGE(TAG, "setMode(): Invalid mode specified!");
-    return false;
-  }
-}
-
-modes InterruptButton::getMode(){
-  return m_mode;
-}
-
-void InterruptButton::asyncQueueServicer(void* pvParams){
-  while(1){
-    if(m_asyncEventQueue[0] != nullptr) {
-      m_asyncEventQueue[0]();                                   // Action the first entry
-
-      for(uint8_t i = 1; i < ASYNC_EVENT_QUEUE_DEPTH; i++) {    // Shift the rest down or clear this entry.
-        m_asyncEventQueue[i - 1] = m_asyncEventQueue[i];
-        if(m_asyncEventQueue[i] == nullptr) break;
-        if(i == ASYNC_EVENT_QUEUE_DEPTH - 1) m_asyncEventQueue[i] = nullptr;
-      }
-    }
-    vTaskDelay(10 / ((TickType_t)1000 / configTICK_RATE_HZ));    // Required to yield to RTOS scheduler during idle times
-  }
-  vTaskDelete(NULL);    // Only reached if we put a condition in the primary while loop based on mode
-}
-
-void InterruptButton::processSyncEvents() {
-  while(m_syncEventQueue[0] != nullptr) {
-    m_syncEventQueue[0]();                                   // Action the first entry
-
-    for(uint8_t i = 1; i < SYNC_EVENT_QUEUE_DEPTH; i++) {    // Shift the rest down or clear this entry.
-        m_syncEventQueue[i - 1] = m_syncEventQueue[i];
-        if(m_syncEventQueue[i] == nullptr) break;
-        if(i == SYNC_EVENT_QUEUE_DEPTH - 1) m_syncEventQueue[i] = nullptr;
-    }
-  }
-}
-
-
-//-- Method to monitor button, called by button change and various timer interrupts ----------------------
-void IRAM_ATTR InterruptButton::readButton(void *arg){
-  if(m_deleteInProgress) return;
-  InterruptButton* btn = reinterpret_cast<InterruptButton*>(arg);
-
-  switch(btn->m_state){
-    case Released:                                              // Was sitting released but just detected a signal from the button
-      gpio_intr_disable(btn->m_pin);                            // Ignore change inputs while we poll for a valid press
-      btn->m_validPolls = 1; btn->m_totalPolls = 1;             // Was released, just detected a change, must be a valid press so count it.
-      btn->m_blockKeyPress = false;
-      startTimer(btn->m_buttonPollTimer, btn->m_pollIntervalUS, &readButton, btn, "DB_begin_");  // Begin debouncing the button input
-      btn->m_state = ConfirmingPress;
-
-      break;
-
-    case ConfirmingPress:                                       // we get here each time the debounce timer expires (onchange interrupt disabled remember)
-      btn->m_totalPolls++;                                      // Count the number of total reads
-      if(gpio_get_level(btn->m_pin) == btn->m_pressedState) btn->m_validPolls++; // Count the number of valid 'PRESSED' reads
-      if(btn->m_totalPolls >= TARGET_POLLS){                   // If we have checked the button enough times, then make a decision on key state
-        if(btn->m_validPolls * 2 <= btn->m_totalPolls) {        // Then it was a false alarm
-          btn->m_state = Released;                                        
-          gpio_intr_enable(btn->m_pin);
-          return;
-        }                                                       // Otherwise, spill over to "Pressing"
-      } else {                                                  // Not yet enough polls to confirm state
-        startTimer(btn->m_buttonPollTimer, btn->m_pollIntervalUS, &readButton, btn, "CP2_");  // Keep sampling pin state
-        return;
-      }
-      [[fallthrough]];                                           // Planned spill through here (no break) if logic requires, ie keyDown confirmed.
-    case Pressing:                                              // VALID KEYDOWN, assumed pressed if it had valid polls more than half the time
-      btn->action(btn, Event_KeyDown);                          // Add the keyDown action to the relevant queue
-      if(btn->eventEnabled(Event_LongKeyPress) && btn->eventActions[m_menuLevel][Event_LongKeyPress] != nullptr){
-        startTimer(btn->m_buttonLPandRepeatTimer, uint64_t(btn->m_longKeyPressMS * 1000), &longPressEvent, btn, "CP1_");
-      } else if (btn->eventEnabled(Event_AutoRepeatPress)) {
-        startTimer(btn->m_buttonLPandRepeatTimer, uint64_t(btn->m_autoRepeatMS * 1000), &autoRepeatPressEvent, btn, "CP1_");
-      }
-
-      btn->m_state = Pressed;
-      gpio_intr_enable(btn->m_pin);                             // Begin monitoring pin again
-      break;
-
-    case Pressed:                                               // Currently pressed until now, but there was a change on the pin
-      gpio_intr_disable(btn->m_pin);                            // Turn off this interrupt to ignore inputs while we wait to check if valid release
-      startTimer(btn->m_buttonPollTimer, btn->m_pollIntervalUS, &readButton, btn, "PR_");  // Start timer and start polling the button to debounce it
-      btn->m_validPolls = 1; btn->m_totalPolls = 1;             // This is first poll and it was just released by definition of state
-      btn->m_state = WaitingForRelease;
-      break;
-
-    case WaitingForRelease: // we get here when debounce timer or doubleclick timeout timer alarms (onchange interrupt disabled remember)
-                            // stay in this state until released, because button could remain locked down if release missed.
-      btn->m_totalPolls++;
-      if(gpio_get_level(btn->m_pin) != btn->m_pressedState){
-        btn->m_validPolls++;
-        if(btn->m_totalPolls < TARGET_POLLS || btn->m_validPolls * 2 <= btn->m_totalPolls) {           // If we haven't polled enough or not high enough success rate
-          startTimer(btn->m_buttonPollTimer, btn->m_pollIntervalUS, &readButton, btn, "W4R_polling_");  // Then keep sampling pin state until release is confirmed
-          return;
-        }                                                       // Otherwise, spill through to "Releasing"
-      } else {
-        if(btn->m_validPolls > 0) {
-          btn->m_validPolls--;
-        } else {
-          btn->m_totalPolls = 0;                                // Key is being held down, don't let total polls get too far ahead.
-        }
-        startTimer(btn->m_buttonPollTimer, btn->m_pollIntervalUS, &readButton, btn, "W4R_invalidPoll"); // Keep sampling pin state until released
-      }
-      [[fallthrough]];                                           // Intended spill through here (no break) to "Releasing" once keyUp confirmed.
-
-    case Releasing:
-      killTimer(btn->m_buttonLPandRepeatTimer);
-      btn->action(btn, Event_KeyUp);                            // Add the keyUp action to the relevant queue
-
-      if(btn->eventEnabled(Event_DoubleClick) && btn->eventEnabled(Event_All) &&     // If double-clicks are enabled and defined
-         btn->eventActions[m_menuLevel][Event_DoubleClick] != nullptr) {
-
-        if(btn->m_wtgForDblClick) {                             // VALID DOUBLE-CLICK (second keyup without a timeout, would normally check 
-          killTimer(btn->m_buttonDoubleClickTimer);             // esp_timer_is_active, but function not available in esp32 arduino core.
-          btn->m_wtgForDblClick = false;
-          btn->action(btn, Event_DoubleClick);                  // Add the double-click action to the relevant queue
-
-        } else if (!btn->m_blockKeyPress) {                     // Commence double-click detection process               
-          btn->m_wtgForDblClick = true;
-          btn->m_doubleClickMenuLevel = m_menuLevel;            // Save menuLevel in case this is converted to a keyPress later
-          startTimer(btn->m_buttonDoubleClickTimer, uint64_t(btn->m_doubleClickMS * 1000), &doubleClickTimeout, btn, "W4R_DCsetup_");
-        }
-      } else if(!btn->m_blockKeyPress) {                        // Otherwise, treat as a basic keyPress
-        btn->action(btn, Event_KeyPress);                       // Then treat as a normal keyPress
-      } 
-      btn->m_state = Released;
-      gpio_intr_enable(btn->m_pin);
-      break;
-  } // End of SWITCH statement
-
-  return;
-} // End of readButton function
-
-
-//-- Method to handle longKeyPresses (called by timer)----------------------------------------------------
-void InterruptButton::longPressEvent(void *arg){
-  if(m_deleteInProgress) return;
-  InterruptButton* btn = reinterpret_cast<InterruptButton*>(arg);
-
-  btn->action(btn, Event_LongKeyPress);                                     // Add the long keypress action to the relevant queue
-  btn->m_blockKeyPress = true;                                              // Used to prevent regular keypress or doubleclick later on in procedure.
-  
-  //Initiate the autorepeat function
-  if(btn->eventEnabled(Event_AutoRepeatPress) && gpio_get_level(btn->m_pin) == btn->m_pressedState) { // Sanity check to stop autorepeats in case we somehow missed button release
-    startTimer(btn->m_buttonLPandRepeatTimer, uint64_t(btn->m_autoRepeatMS * 1000), &autoRepeatPressEvent, btn, "LPD_");
-  }
-}
-
-//-- Method to handle autoRepeatPresses (called by timer)-------------------------------------------------
-void InterruptButton::autoRepeatPressEvent(void *arg){
-  if(m_deleteInProgress) return;
-  InterruptButton* btn = reinterpret_cast<InterruptButton*>(arg);
-  btn->m_blockKeyPress = true;                                              // Used to prevent regular keypress or doubleclick later on in procedure.
-
-  if(btn->eventActions[m_menuLevel][Event_AutoRepeatPress] != nullptr) {
-    btn->action(btn, Event_AutoRepeatPress);                                // Action the Async Auto Repeat KeyPress Event if defined
-  } else {
-    btn->action(btn, Event_KeyPress);                                       // Action the Async KeyPress Event otherwise
-  }
-  if(btn->eventEnabled(Event_AutoRepeatPress) && gpio_get_level(btn->m_pin) == btn->m_pressedState) { // Sanity check to stop autorepeats in case we somehow missed button release
-    startTimer(btn->m_buttonLPandRepeatTimer, uint64_t(btn->m_autoRepeatMS * 1000), &autoRepeatPressEvent, btn, "LPD_");
-  }
-}
-
-//-- Method to return to interpret previous keyUp as a keyPress instead of a doubleClick if it times out.
-void InterruptButton::doubleClickTimeout(void *arg){
-  if(m_deleteInProgress) return;
-  InterruptButton* btn = reinterpret_cast<InterruptButton*>(arg);
-  btn->m_wtgForDblClick = false;
-  if(gpio_get_level(btn->m_pin) != btn->m_pressedState)
-    btn->action(btn, Event_KeyPress, btn->m_doubleClickMenuLevel);                    // Then treat as a normal keyPress at the menuLevel when first click occurred
-                                                                                      // Note, this timer is never started if previous press was a longpress
-}
-
-//-- Helper method to simplify starting a timer ----------------------------------------------------------
-void IRAM_ATTR InterruptButton::startTimer(esp_timer_handle_t &timer, uint32_t duration_US, void (*callBack)(void* arg), InterruptButton* btn, const char *msg){
-  if(m_deleteInProgress) return;
-  esp_timer_create_args_t tmrConfig;
-    tmrConfig.arg = reinterpret_cast<void*>(btn);
-    tmrConfig.callback = callBack;
-    tmrConfig.dispatch_method = ESP_TIMER_TASK;
-    tmrConfig.name = msg;
-    // this line crashes the esp if button was created dynamically.
-  killTimer(timer);
-  esp_timer_create(&tmrConfig, &timer);
-  esp_timer_start_once(timer, duration_US);
-}
-
-//-- Helper method to kill a timer -----------------------------------------------------------------------
-void IRAM_ATTR InterruptButton::killTimer(esp_timer_handle_t &timer){
-  if(timer){
-    esp_timer_stop(timer);
-    esp_timer_delete(timer);
-    timer = nullptr;
-  }
-}
-
-void IRAM_ATTR InterruptButton::action(InterruptButton* btn, events event, uint8_t menuLevel){  
-  if(m_deleteInProgress)                                                      return;
-  if(menuLevel >= m_numMenus)                                                 return;   // Invalid menu level
-  if(!btn->eventEnabled(event) || !btn->eventEnabled(Event_All))              return;   // Specific event is or all events are disabled
-  if(btn->eventActions[menuLevel][event] == nullptr)                          return;   // Event is not defined
-
-  if(m_mode == Mode_Asynchronous || (m_mode == Mode_Hybrid && (event == Event_KeyDown || event == Event_KeyUp))) {
-    for(uint8_t i = 0; i < ASYNC_EVENT_QUEUE_DEPTH; i++){            // Action immediatley using RTOS asynchronous Queue
-      //ESP_LOGD(TAG,"Searching for free spot to add action: %d", i);
-      if(m_asyncEventQueue[i] == nullptr){
-        //ESP_LOGD(TAG,"\tAdding entry at position: %d", i);
-        m_asyncEventQueue[i] = btn->eventActions[menuLevel][event];
-        break;
-      }
-    }
-  } else {                                                           // Action when called in main loop hook using synchronous Queue
-    for(uint8_t i = 0; i < SYNC_EVENT_QUEUE_DEPTH; i++){
-      if(m_syncEventQueue[i] == nullptr){
-        m_syncEventQueue[i] = btn->eventActions[menuLevel][event];
-        break;
-      }
-    }
-  }  
-}
-
-
-
-//-- CLASS MEMBERS AND METHODS SPECIFIC TO A SINGLE INSTANCE (BUTTON) ------------------------------------
-//--------------------------------------------------------------------------------------------------------
-//--------------------------------------------------------------------------------------------------------
-//--------------------------------------------------------------------------------------------------------
-
-// Class object control and setup functions -------------------------------------
-// ------------------------------------------------------------------------------
-
-// Constructor ------------------------------------------------------------------
-InterruptButton::InterruptButton(uint8_t pin, uint8_t pressedState, gpio_mode_t pinMode,
-                                 uint16_t longKeyPressMS, uint16_t autoRepeatMS, 
-                                 uint16_t doubleClickMS,  uint32_t debounceUS) :
-                                 m_pressedState(pressedState),
-                                 m_pinMode(pinMode),
-                                 m_longKeyPressMS(longKeyPressMS),
-                                 m_autoRepeatMS(autoRepeatMS),
-                                 m_doubleClickMS(doubleClickMS) {
-
-  if (GPIO_IS_VALID_GPIO(pin))                  // Check for a valid pin first
-    m_pin = static_cast<gpio_num_t>(pin);
-  else {
-    ESP_LOGW(TAG, "%d is not valid gpio on this platform", pin);
-    m_pin = static_cast<gpio_num_t>(-1);        //GPIO_NUM_NC (enum not showing up as defined);
-  }
-  m_pollIntervalUS = (debounceUS / TARGET_POLLS > 65535) ? 65535 : debounceUS / TARGET_POLLS;
-}
-
-// Destructor --------------------------------------------------------------------
-InterruptButton::~InterruptButton() {
-  m_deleteInProgress = true;
-  gpio_isr_handler_remove(m_pin);
-  killTimer(m_buttonPollTimer); killTimer(m_buttonLPandRepeatTimer); killTimer(m_buttonDoubleClickTimer);
-  gpio_reset_pin(m_pin);
-
-  for(int menu = 0; menu < m_numMenus; menu++) delete [] eventActions[menu];
-  delete [] eventActions;
-  m_deleteInProgress = false;
-}
-
-// Initialiser -------------------------------------------------------------------
-void InterruptButton::initialiseInstance(void){
-    if(m_thisButtonInitialised) return;
-
-    if(!m_classInitialised){                    // We must be initialising the first button
-      if(m_numMenus == 0) m_numMenus = 1;       // Default to a single menu level if not set prior to initialising first button
-      esp_err_t err = gpio_install_isr_service(ESP_INTR_FLAG_DEFAULT);
-      if(err != ESP_OK) ESP_LOGD(TAG, "GPIO ISR service installed with exit status: %d", err);
-      m_classInitialised = setMode(m_mode) && (err == ESP_OK || err == ESP_ERR_INVALID_STATE);
-    }
-
-    eventActions = new func_ptr_t*[m_numMenus];             // Define the array of actions associated with each button
-    for(int menu = 0; menu < m_numMenus; menu++){
-      eventActions[menu] = new func_ptr_t[NumEventTypes];
-      for(int evt = 0; evt < NumEventTypes; evt++){
-        eventActions[menu][evt] = nullptr;
-      }
-    }
-    gpio_config_t gpio_conf = {};                           // Configure the interrupt associated with the pin
-      gpio_conf.mode = m_pinMode;
-      gpio_conf.pin_bit_mask = BIT64(static_cast<uint8_t>(m_pin));
-      gpio_conf.pull_down_en = (m_pressedState) ? GPIO_PULLDOWN_ENABLE : GPIO_PULLDOWN_DISABLE;
-      gpio_conf.pull_up_en =   (m_pressedState) ? GPIO_PULLUP_DISABLE : GPIO_PULLUP_ENABLE;
-      gpio_conf.intr_type = GPIO_INTR_ANYEDGE;
-    gpio_config(&gpio_conf);
-    gpio_isr_handler_add(m_pin, InterruptButton::readButton, reinterpret_cast<void*>(this));
-    m_state = (gpio_get_level(m_pin) == m_pressedState) ? Pressed : Released;     // Set to current state when initialising
-    m_thisButtonInitialised = true;
-}
-
-
-//-- TIMING INTERVAL GETTERS AND SETTERS -----------------------------------------------------------------
-void      InterruptButton::setLongPressInterval(uint16_t intervalMS)    { m_longKeyPressMS = intervalMS; }
-uint16_t  InterruptButton::getLongPressInterval(void)                   { return m_longKeyPressMS;       }
-void      InterruptButton::setAutoRepeatInterval(uint16_t intervalMS)   { m_autoRepeatMS = intervalMS;   }
-uint16_t  InterruptButton::getAutoRepeatInterval(void)                  { return m_autoRepeatMS;         }
-void      InterruptButton::setDoubleClickInterval(uint16_t intervalMS)  { m_doubleClickMS = intervalMS;  }
-uint16_t  InterruptButton::getDoubleClickInterval(void)                 { return m_doubleClickMS;        }
-
-
-// -- FUNCTIONS RELATED TO EXTERNAL ACTIONS --------------------------------------------------------------
-// -------------------------------------------------------------------------------------------------------
-void InterruptButton::bind(events event, uint8_t menuLevel, func_ptr_t action){
-  if(!m_thisButtonInitialised) initialiseInstance();    // Auto initialisation (typical begin() function)
-
-  if(menuLevel >= m_numMenus) {
-    ESP_LOGE(TAG, "Specified menu level is greater than the number of menus!");
-  } else if(event >= NumEventTypes) {
-    ESP_LOGE(TAG, "Specified event is invalid!");
-  } else {
-    eventActions[menuLevel][event] = action;            // Bind external action to button
-    if(!eventEnabled(event)) enableEvent(event);        // Assume if we are binding it, we want it enabled.
-  }
-}
-
-void InterruptButton::unbind(events event, uint8_t menuLevel){
-  if(m_numMenus == 0){
-    ESP_LOGE(TAG, "You must have bound at least one function prior to unbinding it from a button!");
-  } else if(menuLevel >= m_numMenus) {
-    ESP_LOGE(TAG, "Specified menu level is greater than the number of menus!");
-  } else if(event >= NumEventTypes) {
-    ESP_LOGE(TAG, "Specified event is invalid!");
-  } else {
-    eventActions[menuLevel][event] = nullptr;
-  }
-  return;
-}
-
-void InterruptButton::enableEvent(events event){
-  if(event <= Event_All && event != NumEventTypes) eventMask |= (1UL << (event));    // Set the relevant bit
-}
-void InterruptButton::disableEvent(events event){
-  if(event <= Event_All && event != NumEventTypes) eventMask &= ~(1UL << (event));   // Clear the relevant bit
-}
-bool InterruptButton::eventEnabled(events event) {
-  return ((eventMask >> event) & 0x01) == 0x01;
-}
-
-void InterruptButton::setMenuCount(uint8_t numberOfMenus){           // This can only be set before initialising first button
-  if(!m_classInitialised && numberOfMenus >= 1) m_numMenus = numberOfMenus;
-}
-uint8_t InterruptButton::getMenuCount(void) {
-  return m_numMenus;
-}
-
-void InterruptButton::setMenuLevel(uint8_t level) {
-  if(level < m_numMenus) {
-    m_menuLevel = level;
-  } else {
-    ESP_LOGE(TAG, "Menu level '%d' must be >= 0 AND < number of menus (zero origin): ", level);
-  }
-}
-
-uint8_t InterruptButton::getMenuLevel(){
-  return m_menuLevel;
-}
+#include "InterruptButton.h"
+
+#include "soc/soc.h"
+#include "soc/gpio_reg.h"
+#include "esp_sleep.h"
+#include <cstring>
+#if SOC_PM_SUPPORT_EXT1_WAKEUP
+#include "driver/rtc_io.h"
+#endif
+
+// Include reference req'd for debugging and warnings across serial port.
+#ifdef ARDUINO
+#include "esp32-hal-log.h"
+#else
+#include "esp_log.h"
+#endif
+
+
+#define ESP_INTR_FLAG_DEFAULT   0
+#define EVENT_TASK_NAME         "BTN_ACTN"
+
+static_assert(IBTN_ASYNC_LANES >= 1 && IBTN_ASYNC_LANES <= 4, "IBTN_ASYNC_LANES must be 1 to 4");
+static_assert(IBTN_MAX_WORKERS >= 1 && IBTN_MAX_WORKERS <= 8, "IBTN_MAX_WORKERS must be 1 to 8");
+static const char* const laneTaskNames[] = { EVENT_TASK_NAME, EVENT_TASK_NAME "1", EVENT_TASK_NAME "2", EVENT_TASK_NAME "3" };  // Pool workers share the lane's name
+
+static const char* TAG = "IBTN";              // IDF log tag
+
+#if IBTN_STATS
+#define STAT_COUNT(btn, counter)  countStat(btn, &InterruptButtonStats::counter)
+#else
+#define STAT_COUNT(btn, counter)                // Stats compiled out
+#endif
+
+#if IBTN_HISTORY_DEPTH
+static_assert((IBTN_HISTORY_DEPTH & (IBTN_HISTORY_DEPTH - 1)) == 0 && IBTN_HISTORY_DEPTH <= 256, "IBTN_HISTORY_DEPTH must be a power of two, max 256");
+#define HISTORY(btn, ...)         record(btn, __VA_ARGS__)
+#else
+#define HISTORY(btn, ...)                       // History compiled out
+#endif
+
+#if IBTN_TRACE == 1
+#include "SEGGER_SYSVIEW.h"
+static SEGGER_SYSVIEW_MODULE traceModule = {      // Event ids are offset from the module's, given when it is registered
+  "M=IBTN, 0 State Btn=%u State=%u, 1 Enqueue Btn=%u Event=%u, 2 Drop Btn=%u Event=%u, 3 Dispatch Btn=%u Event=%u, 4 Done Btn=%u Event=%u",
+  NumTracePoints, 0, nullptr, nullptr
+};
+#define TRACE_AS(point, id, value)  SEGGER_SYSVIEW_RecordU32x2(traceModule.EventOffset + (point), (id), (value))
+#elif IBTN_TRACE == 2
+#define TRACE_AS(point, id, value)  ibtnTrace((point), (id), (value))
+#else
+#define TRACE_AS(point, id, value)              // Tracing compiled out
+#endif
+#define TRACE(point, btn, value)    TRACE_AS(point, traceId(btn), value)
+#define ENTER_STATE(btn, state)     do { (btn)->m_state = (state); TRACE(Trace_State, btn, (btn)->m_state); } while(0)
+
+
+
+/* ToDo
+  1. Need to confirm if any ISR's need to blocked/disabled from other ISR entry, ie portMUX highlevel/lowlevel, etc.
+  2. Consider Adding button eventTypes such as momentary, latching, etc.
+*/
+
+//-- STATIC CLASS MEMBERS AND METHODS (COMMON ACROSS ALL INSTANCES TO SAVE MEMORY) -----------------------
+//--------------------------------------------------------------------------------------------------------
+//--------------------------------------------------------------------------------------------------------
+//--------------------------------------------------------------------------------------------------------
+
+//-- Initialise Static Member Variables ------------------------------------------------------------------
+//--------------------------------------------------------------------------------------------------------
+uint32_t      InterruptButton::m_RTOSservicerStackDepth                     { EVENT_TASK_STACK };
+uint8_t       InterruptButton::m_numMenus                                   { 0 };  // 0 Means not initialised, can be set by user; once set it can't be changed.
+uint8_t       InterruptButton::m_menuLevel                                  { 0 };
+modes         InterruptButton::m_mode                                       { Mode_Asynchronous };
+bool          InterruptButton::m_classInitialised                           { false };
+InterruptButtonRing<ButtonEvent, ASYNC_EVENT_QUEUE_DEPTH> InterruptButton::m_asyncEventQueue[IBTN_ASYNC_LANES];
+InterruptButtonRing<ButtonEvent, SYNC_EVENT_QUEUE_DEPTH>  InterruptButton::m_syncEventQueue;
+InterruptButton::worker_t InterruptButton::m_workers[IBTN_ASYNC_LANES][IBTN_MAX_WORKERS];
+#if IBTN_MAX_WORKERS > 1
+volatile uint8_t InterruptButton::m_idleWorkers[IBTN_ASYNC_LANES]           = {};
+portMUX_TYPE  InterruptButton::m_poolMux                                    = portMUX_INITIALIZER_UNLOCKED;
+#endif
+InterruptButton::laneTask_t InterruptButton::m_laneTasks[IBTN_ASYNC_LANES]  = {};
+bool          InterruptButton::m_sharedTimers                               { false };
+esp_timer_dispatch_t InterruptButton::m_timerDispatch                       { ESP_TIMER_TASK };
+esp_timer_handle_t InterruptButton::m_schedulerTimer                        { nullptr };
+InterruptButton::deadline_t* InterruptButton::m_schedulerHead               { nullptr };
+portMUX_TYPE  InterruptButton::m_schedulerMux                               = portMUX_INITIALIZER_UNLOCKED;
+InterruptButton::bank_t InterruptButton::m_banks[IBTN_GPIO_BANKS]           = {};
+portMUX_TYPE  InterruptButton::m_bankMux                                    = portMUX_INITIALIZER_UNLOCKED;
+InterruptButton::chord_t InterruptButton::m_chords[IBTN_MAX_CHORDS]          = {};
+uint8_t       InterruptButton::m_numChords                                  { 0 };
+InterruptButton* InterruptButton::m_chordButtons[32]                        = {};
+volatile uint32_t InterruptButton::m_pressedMask                            { 0 };
+portMUX_TYPE  InterruptButton::m_chordMux                                   = portMUX_INITIALIZER_UNLOCKED;
+InterruptButton* InterruptButton::m_firstButton                             { nullptr };
+portMUX_TYPE  InterruptButton::m_buttonsMux                                 = portMUX_INITIALIZER_UNLOCKED;
+InterruptButton* InterruptButton::m_wakeButtons[IBTN_MAX_WAKE_BUTTONS]       = {};
+uint8_t       InterruptButton::m_numWakeButtons                             = 0;
+bool          InterruptButton::m_lightSleepArmed                            = false;
+bool          InterruptButton::m_wakeReplayed                               = false;
+portMUX_TYPE  InterruptButton::m_repeatMux                                  = portMUX_INITIALIZER_UNLOCKED;
+#if IBTN_HISTORY_DEPTH
+InterruptButton::gesture_t InterruptButton::m_gestures[IBTN_MAX_GESTURES]   = {};
+uint8_t       InterruptButton::m_numGestures                                { 0 };
+portMUX_TYPE  InterruptButton::m_historyMux                                 = portMUX_INITIALIZER_UNLOCKED;
+#endif
+#if IBTN_STATS
+InterruptButtonStats InterruptButton::m_classStats                          = {};
+portMUX_TYPE  InterruptButton::m_statsMux                                   = portMUX_INITIALIZER_UNLOCKED;
+#endif
+
+// This is used to initialise the queue(s) and also switch between them.  Nothing already queued is dropped: the
+// servicers stay up (blocked, so costing nothing) to finish what is on the asynchronous queues whatever the new mode,
+// and switching to Mode_Asynchronous hands anything waiting for processSyncEvents() over to the lanes' servicers.
+// Call it from the task that calls processSyncEvents(), as it takes over the synchronous queue while it does so.
+bool InterruptButton::setMode(modes mode){
+  if(mode != Mode_Asynchronous && mode != Mode_Hybrid && mode != Mode_Synchronous) {
+    ESP_LOGE(TAG, "setMode(): Invalid mode specified!");
+    return false;
+  }
+  m_mode = mode;
+  if(mode == Mode_Synchronous) return true;
+
+  // Start the RTOS queue action service/task for each lane
+  bool retVal = true;
+  for(uint8_t lane = 0; lane < IBTN_ASYNC_LANES; lane++) {
+    const laneTask_t &cfg = m_laneTasks[lane];
+    for(uint8_t w = 0; w < laneWorkers(lane); w++) {
+      worker_t &worker = m_workers[lane][w];
+      if(worker.task != nullptr) continue;
+      BaseType_t core = cfg.workerCoresSet ? cfg.workerCores[w] : cfg.set ? cfg.core : EVENT_TASK_CORE;
+      worker.lane = lane;
+      retVal = xTaskCreatePinnedToCore(asyncQueueServicer, laneTaskNames[lane], m_RTOSservicerStackDepth, &worker,
+                                       cfg.set ? cfg.priority : EVENT_TASK_PRIORITY + lane, &worker.task, core) == pdPASS && retVal;
+    }
+  }
+  if(!retVal) ESP_LOGE(TAG, "setMode(): Failed to create RTOS queue servicing task!");
+
+  while(retVal && mode == Mode_Asynchronous) {                // Drain the synchronous queue onto the lanes, in order
+    uint8_t lane = 0;
+    bool moved = true;
+    {
+      ButtonEvent pending;
+      if(!m_syncEventQueue.peek(pending, claim)) break;       // Left in place until it is on its lane
+      useGuard guard(useCount(pending.button), true);         // Until then, as the lanes are purged once no guard is held
+      if(pending.button != nullptr && !pending.button->m_retiring) {
+        lane = pending.button->laneOf(pending.event);
+        moved = m_asyncEventQueue[lane].push(pending);
+        if(moved) notifyServicer(lane);
+      }
+      if(moved) m_syncEventQueue.pop(pending);
+    }
+    if(moved) continue;
+    if(laneWorkers(lane) <= 1 && m_workers[lane][0].task == xTaskGetCurrentTaskHandle()) {
+      auto &queue = m_asyncEventQueue[lane];                  // Called from an action on the full lane, which can't drain
+      dispatchNext([&queue](ButtonEvent &evt){ return queue.pop(evt, claim); });   // while we wait, so run its oldest entry here
+    } else {
+      vTaskDelay(1);                                          // Full, let the servicer catch up rather than lose it.  Without
+    }                                                         // the guard, so a button can be deleted meanwhile
+  }
+  return retVal;
+}
+
+modes InterruptButton::getMode(){
+  return m_mode;
+}
+
+void InterruptButton::asyncQueueServicer(void* pvParams){
+  worker_t &worker = *reinterpret_cast<worker_t*>(pvParams);
+  auto &queue = m_asyncEventQueue[worker.lane];
+  while(1){
+#if IBTN_MAX_WORKERS > 1
+    if(laneWorkers(worker.lane) > 1) {                          // Worker pool, the queue is shared with the lane's other workers
+      if(dispatchNext([&worker](ButtonEvent &evt){ return takePooled(worker, evt); })) {
+        finishPooled(worker);
+      } else {
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);                // Nothing for us, sleep until action() picks this worker
+      }
+      continue;
+    }
+#endif
+    ulTaskNotifyTake(pdTRUE, portMAX_DELAY);                    // Sleep until action() posts an event (no idle wake-ups)
+    while(dispatchNext([&queue](ButtonEvent &evt){ return queue.pop(evt, claim); }));   // Action entries in the order they were added
+  }
+  vTaskDelete(NULL);    // Only reached if we put a condition in the primary while loop based on mode
+}
+
+//-- Helper method to wake the RTOS queue servicer, action() is called from both ISR and task contexts --
+void IRAM_ATTR InterruptButton::notifyServicer(uint8_t lane){
+  TaskHandle_t task = m_workers[lane][0].task;
+#if IBTN_MAX_WORKERS > 1
+  if(laneWorkers(lane) > 1) {                                 // Wake one idle worker, busy ones look again when they finish
+    portENTER_CRITICAL_SAFE(&m_poolMux);
+    uint8_t idle = m_idleWorkers[lane];
+    task = nullptr;
+    if(idle != 0) {
+      uint8_t w = static_cast<uint8_t>(__builtin_ctz(idle));
+      m_idleWorkers[lane] = idle & ~(1U << w);
+      task = m_workers[lane][w].task;
+    }
+    portEXIT_CRITICAL_SAFE(&m_poolMux);
+  }
+#endif
+  if(task == nullptr) return;
+  if(xPortInIsrContext()) {
+    BaseType_t higherPriorityTaskWoken = pdFALSE;
+    vTaskNotifyGiveFromISR(task, &higherPriorityTaskWoken);
+    if(higherPriorityTaskWoken) portYIELD_FROM_ISR();
+  } else {
+    xTaskNotifyGive(task);
+  }
+}
+
+//-- Lanes: separate asynchronous queues and servicers, so urgent events never wait behind slow actions ---
+// Servicers already started take the new priority straight away but stay pinned where they are, the core is only
+// used by servicers started after this (setMode()).  Pool workers given cores of their own by setLaneWorkers() ignore it.
+bool InterruptButton::setLaneTask(uint8_t lane, UBaseType_t priority, BaseType_t core){
+  if(lane >= IBTN_ASYNC_LANES) {
+    ESP_LOGE(TAG, "setLaneTask(): Lane %d is invalid, IBTN_ASYNC_LANES is %d", lane, IBTN_ASYNC_LANES);
+    return false;
+  }
+  if(!validCore(core)) {
+    ESP_LOGE(TAG, "setLaneTask(): Core %d is invalid (ESP_ERR_INVALID_ARG), use 0 to %d or tskNO_AFFINITY", static_cast<int>(core), portNUM_PROCESSORS - 1);
+    return false;
+  }
+  m_laneTasks[lane].priority = priority;
+  m_laneTasks[lane].core = core;
+  m_laneTasks[lane].set = true;
+  bool started = false;
+  for(worker_t &worker : m_workers[lane]) {
+    if(worker.task == nullptr) continue;
+    vTaskPrioritySet(worker.task, priority);
+    started = true;
+  }
+  if(started) ESP_LOGW(TAG, "setLaneTask(): Lane %d servicer already started, its priority is changed but not its core", lane);
+  return true;
+}
+
+bool InterruptButton::validCore(BaseType_t core){
+  return core == tskNO_AFFINITY || (core >= 0 && core < portNUM_PROCESSORS);
+}
+
+//-- Worker pool: several servicers take from one lane's queue, one button at a time per worker -------------
+// Taking an event and claiming its button happen together under m_poolMux, so events are claimed in queue order.
+// An event for a button another worker is busy with is handed over to that worker, which runs it next, so each
+// button's actions still run one after another in the order they were raised.
+bool InterruptButton::setLaneWorkers(uint8_t lane, uint8_t workers, const BaseType_t cores[]){
+  if(lane >= IBTN_ASYNC_LANES || workers < 1 || workers > IBTN_MAX_WORKERS) {
+    ESP_LOGE(TAG, "setLaneWorkers(): Lane %d or %d workers is invalid (IBTN_MAX_WORKERS is %d)", lane, workers, IBTN_MAX_WORKERS);
+    return false;
+  }
+  if(m_workers[lane][0].task != nullptr) {
+    ESP_LOGE(TAG, "setLaneWorkers(): Lane %d has already been started!", lane);
+    return false;
+  }
+  for(uint8_t w = 0; cores != nullptr && w < workers; w++) {
+    if(validCore(cores[w])) continue;
+    ESP_LOGE(TAG, "setLaneWorkers(): Core %d is invalid (ESP_ERR_INVALID_ARG), use 0 to %d or tskNO_AFFINITY", static_cast<int>(cores[w]), portNUM_PROCESSORS - 1);
+    return false;
+  }
+  laneTask_t &cfg = m_laneTasks[lane];
+  cfg.workers = workers;
+  cfg.workerCoresSet = (cores != nullptr);
+  for(uint8_t w = 0; cores != nullptr && w < workers; w++) cfg.workerCores[w] = cores[w];
+  return true;
+}
+
+#if IBTN_MAX_WORKERS > 1
+bool InterruptButton::takePooled(worker_t &worker, ButtonEvent &evt){
+  auto &queue = m_asyncEventQueue[worker.lane];
+  bool taken = false;
+  portENTER_CRITICAL_SAFE(&m_poolMux);
+  m_idleWorkers[worker.lane] &= ~(1U << (&worker - m_workers[worker.lane]));
+  while(!taken && queue.pop(evt, claim)) {
+    InterruptButton* btn = evt.button;
+    if(btn == nullptr) continue;                              // Purged, its button was deleted
+    worker_t* busy = nullptr;
+    for(worker_t &other : m_workers[worker.lane]) if(other.current == btn) busy = &other;
+    if(busy == nullptr) {
+      worker.current = btn;
+      taken = true;                                           // Still claimed, for dispatchNext()
+      continue;
+    }
+    if(btn->m_retiring) {                                     // Its hand over queues may be purged already, don't add to them
+    } else if(!busy->handoff.push(evt)) {
+      TRACE(Trace_Drop, btn, evt.event);
+#if IBTN_STATS
+      countQueued(btn, &InterruptButtonStats::asyncQueue, false, busy->handoff.size());   // Lost like a full queue's, with the drops
+#endif
+      ESP_LOGD(TAG, "Worker pool: hand over queue full, event dropped");
+    }
+    btn->m_inUse.fetch_sub(1, std::memory_order_release);    // Not ours to run, the busy worker claims it again
+  }
+  if(!taken) m_idleWorkers[worker.lane] |= 1U << (&worker - m_workers[worker.lane]);   // Before the lock is released, so no wake is missed
+  portEXIT_CRITICAL_SAFE(&m_poolMux);
+  return taken;
+}
+
+void InterruptButton::finishPooled(worker_t &worker){
+  auto takeHandedOver = [&worker](ButtonEvent &evt){
+    portENTER_CRITICAL_SAFE(&m_poolMux);
+    bool more = worker.handoff.pop(evt, claim);
+    if(!more) worker.current = nullptr;                       // Free for any worker to take its next event
+    portEXIT_CRITICAL_SAFE(&m_poolMux);
+    return more;
+  };
+  while(dispatchNext(takeHandedOver));
+}
+#endif
+
+//-- Main loop dispatch, a render loop can give it a budget and leave the rest for the next frame.  The time is checked
+// between actions, so a single slow action can still overrun it, and at least one event is always processed. --------
+uint16_t InterruptButton::processSyncEvents(uint16_t maxEvents, uint32_t maxMicros) {
+  int64_t startUS = (maxMicros != 0) ? esp_timer_get_time() : 0;
+  bool ran = false;
+  for(uint16_t done = 0; maxEvents == 0 || done < maxEvents; done += ran) {  // Skipped entries (ie of a deleted button) aren't counted
+    if(!dispatchNext([](ButtonEvent &evt){ return m_syncEventQueue.pop(evt, claim); }, &ran)) break;  // Action entries in the order they were added
+    if(ran && maxMicros != 0 && esp_timer_get_time() - startUS >= maxMicros) break;
+  }
+  return m_syncEventQueue.size();
+}
+
+uint16_t InterruptButton::pendingSyncEvents(void) {
+  return m_syncEventQueue.size();
+}
+
+//-- Method to take the next event and run its action, the button can be deleted (even by the action) once it starts --
+template<typename F>
+bool InterruptButton::dispatchNext(F take, bool* ran){
+  ButtonEvent evt;
+  boundAction_t bound;
+  [[maybe_unused]] uint32_t traceBtn = 0;                               // Taken while the button is sure to be there
+#if IBTN_USE_STD_FUNCTION
+  func_ptr_t fn;
+#endif
+  {
+    if(!take(evt))                                            return false;   // take() claim()s the entry's button
+    useGuard guard(useCount(evt.button), true);                         // From taking the entry off its queue to copying the action
+    bool ready = prepareAction(evt, bound);
+    if(ran != nullptr) *ran = ready;
+    if(!ready)                                                return true;
+    traceBtn = traceId(evt.button);
+#if IBTN_USE_STD_FUNCTION
+    if(bound.fn == &invokeAction) fn = *static_cast<func_ptr_t*>(bound.ctx);   // Deleting the button frees the bound original
+#endif
+  }
+  TRACE_AS(Trace_DispatchBegin, traceBtn, evt.event);
+#if IBTN_USE_STD_FUNCTION
+  if(bound.fn == &invokeAction) {
+    fn();
+    TRACE_AS(Trace_DispatchEnd, traceBtn, evt.event);
+    return true;
+  }
+#endif
+  bound.fn(bound.ctx, evt);
+  TRACE_AS(Trace_DispatchEnd, traceBtn, evt.event);
+  return true;
+}
+
+//-- Method to find the action bound to a queued event (looked up now, so binding changes are respected) --
+bool InterruptButton::prepareAction(ButtonEvent &evt, boundAction_t &bound){
+  InterruptButton* btn = evt.button;
+  if(btn == nullptr || btn->m_retiring)                       return false;   // Button was deleted while its event was queued
+  if(coalescedEntry(evt)) {                                             // Coalesced autoRepeat or rotation, collect everything counted up to now
+    portENTER_CRITICAL_SAFE(&m_repeatMux);
+    evt.data = btn->m_pendingCount;
+    btn->m_pendingCount = 0;
+    btn->m_coalescedQueued = false;
+    portEXIT_CRITICAL_SAFE(&m_repeatMux);
+    if(evt.data == 0)                                         return false;
+  }
+#if IBTN_HISTORY_DEPTH
+  if(evt.event == Event_Gesture) {                                      // Gesture, the matching is done here rather than in the ISR
+    evt.data = matchGesture(btn, evt.timestampUS);
+    if(evt.data < 0)                                          return false;
+  }
+#endif
+  if(evt.menuLevel >= btn->m_actionRows)                      return false;
+  bound = btn->actionAt(evt.menuLevel, evt.event);                      // Copy, in case the action rebinds itself
+  if(bound.fn == nullptr)                                     return false;   // Unbound since it was queued
+  btn->m_lastEvent = evt;
+#if IBTN_STATS
+  countDispatch(btn, static_cast<uint32_t>(esp_timer_get_time()) - evt.timestampUS);
+#endif
+  return true;
+}
+
+//-- Method to run an action bound as a func_ptr_t -------------------------------------------------------
+void InterruptButton::invokeAction(void* ctx, [[maybe_unused]] const ButtonEvent &evt){
+#if IBTN_USE_STD_FUNCTION
+  func_ptr_t fn = *static_cast<func_ptr_t*>(ctx);                     // Copy, in case the action rebinds itself
+  fn();
+#else
+  reinterpret_cast<func_ptr_t>(ctx)();
+#endif
+}
+
+
+//-- Method to monitor button, called by button change and various timer interrupts ----------------------
+void IRAM_ATTR InterruptButton::readButton(void *arg){
+  InterruptButton* btn = reinterpret_cast<InterruptButton*>(arg);
+  useGuard guard(&btn->m_inUse);
+  if(btn->m_retiring) return;
+
+  switch(btn->m_state){
+    case Released:                                              // Was sitting released but just detected a signal from the button
+      btn->pinInterrupt(false);                                // Ignore change inputs while we poll for a valid press
+      STAT_COUNT(btn, edges);
+      btn->m_validPolls = 1; btn->m_totalPolls = 1;             // Was released, just detected a change, must be a valid press so count it.
+      btn->m_blockKeyPress = false;
+      btn->m_edgeUS = static_cast<uint32_t>(esp_timer_get_time());
+      startTimer(btn, Timer_Poll, btn->m_pollIntervalUS); // Begin debouncing the button input
+      fastKeyDown(btn);
+      ENTER_STATE(btn, ConfirmingPress);
+
+      break;
+
+    case ConfirmingPress:                                       // we get here each time the debounce timer expires (onchange interrupt disabled remember)
+      if(btn->edgeTimestamped()) {                              // Edges are still being captured, so just wait for the line to go quiet
+        uint32_t edgeUS;
+        if(!lineSettled(btn, edgeUS)) return;
+        if(btn->pinLevel() != btn->m_pressedState) {            // It settled released, so it was a false alarm
+          ENTER_STATE(btn, Released);
+          STAT_COUNT(btn, falseAlarms);
+          cancelFastKeyDown(btn);
+          if(btn->m_lastEdgeUS != edgeUS) edgeCapture(btn);     // An edge slipped in while deciding, start again
+          return;
+        }                                                       // Otherwise, spill over to "Pressing"
+      } else {
+        btn->m_totalPolls++;                                    // Count the number of total reads
+        if(btn->pinLevel() == btn->m_pressedState) btn->m_validPolls++; // Count the number of valid 'PRESSED' reads
+        if(btn->m_totalPolls >= TARGET_POLLS){                 // If we have checked the button enough times, then make a decision on key state
+          if(btn->m_validPolls * 2 <= btn->m_totalPolls) {      // Then it was a false alarm
+            ENTER_STATE(btn, Released);
+            STAT_COUNT(btn, falseAlarms);
+            cancelFastKeyDown(btn);
+            btn->pinInterrupt(true);
+            return;
+          }                                                     // Otherwise, spill over to "Pressing"
+        } else {                                                // Not yet enough polls to confirm state
+          startTimer(btn, Timer_Poll, btn->m_pollIntervalUS); // Keep sampling pin state
+          return;
+        }
+      }
+      if(deferClassify(btn, Pressing)) return;
+      [[fallthrough]];                                           // Planned spill through here (no break) if logic requires, ie keyDown confirmed.
+    case Pressing:                                              // VALID KEYDOWN, assumed pressed if it had valid polls more than half the time
+      HISTORY(btn, History_Press, btn->m_edgeUS);
+      if(countsClicks() && btn->m_clickCount) killTimer(btn, Timer_DoubleClick);   // Another click began in time, counted when it ends
+      if(!btn->m_keyDownSent) btn->action(btn, Event_KeyDown);  // Add the keyDown action to the relevant queue (unless already sent early)
+      btn->m_keyDownSent = false;
+      if(compiledIn(Event_Chord) && btn->m_chordBit) chordPressed(btn);
+      if(btn->m_blockKeyPress) {                                // Completed a chord, which takes over from its buttons' own events
+      } else if(btn->eventEnabled(Event_LongKeyPress) && btn->actionBound(btn->menuLevel(), Event_LongKeyPress)){
+        btn->m_autoRepeating = false;
+        startTimer(btn, Timer_LPandRepeat, uint64_t(btn->m_longKeyPressMS * 1000));
+      } else if (btn->eventEnabled(Event_AutoRepeatPress)) {
+        btn->m_autoRepeating = true;
+        startTimer(btn, Timer_LPandRepeat, uint64_t(btn->m_autoRepeatMS * 1000));
+      }
+
+      ENTER_STATE(btn, Pressed);
+      btn->pinInterrupt(true);                                 // Begin monitoring pin again
+      break;
+
+    case Pressed:                                               // Currently pressed until now, but there was a change on the pin
+      btn->pinInterrupt(false);                                // Turn off this interrupt to ignore inputs while we wait to check if valid release
+      STAT_COUNT(btn, edges);
+      startTimer(btn, Timer_Poll, btn->m_pollIntervalUS); // Start timer and start polling the button to debounce it
+      btn->m_validPolls = 1; btn->m_totalPolls = 1;             // This is first poll and it was just released by definition of state
+      btn->m_edgeUS = static_cast<uint32_t>(esp_timer_get_time());
+      ENTER_STATE(btn, WaitingForRelease);
+      break;
+
+    case WaitingForRelease: // we get here when debounce timer or doubleclick timeout timer alarms (onchange interrupt disabled remember)
+                            // stay in this state until released, because button could remain locked down if release missed.
+      if(btn->edgeTimestamped()) {
+        uint32_t edgeUS;
+        if(!lineSettled(btn, edgeUS)) return;
+        if(btn->pinLevel() == btn->m_pressedState) {            // It settled pressed, so it was noise while being held
+          ENTER_STATE(btn, Pressed);
+          STAT_COUNT(btn, falseAlarms);
+          if(btn->m_lastEdgeUS != edgeUS) edgeCapture(btn);     // An edge slipped in while deciding, start again
+          return;
+        }                                                       // Otherwise, spill through to "Releasing"
+      } else {
+        btn->m_totalPolls++;
+        if(btn->pinLevel() != btn->m_pressedState){
+          btn->m_validPolls++;
+          if(btn->m_totalPolls < TARGET_POLLS || btn->m_validPolls * 2 <= btn->m_totalPolls) {           // If we haven't polled enough or not high enough success rate
+            startTimer(btn, Timer_Poll, btn->m_pollIntervalUS); // Then keep sampling pin state until release is confirmed
+            return;
+          }                                                     // Otherwise, spill through to "Releasing"
+        } else {
+          if(btn->m_validPolls > 0) {
+            btn->m_validPolls--;
+          } else {
+            btn->m_totalPolls = 0;                              // Key is being held down, don't let total polls get too far ahead.
+          }
+          startTimer(btn, Timer_Poll, btn->m_pollIntervalUS); // Keep sampling pin state until released
+          return;
+        }
+      }
+      if(deferClassify(btn, Releasing)) return;
+      [[fallthrough]];                                           // Intended spill through here (no break) to "Releasing" once keyUp confirmed.
+
+    case Releasing: {
+      uint8_t menuLevel = btn->menuLevel();                     // Read once, setMenuLevel() may be called part way through
+      killTimer(btn, Timer_LPandRepeat);
+      if(compiledIn(Event_Chord) && btn->m_chordBit) chordReleased(btn);
+      HISTORY(btn, History_Release, btn->m_edgeUS);
+      btn->action(btn, Event_KeyUp, menuLevel, btn->m_edgeUS);  // Add the keyUp action to the relevant queue
+#if IBTN_HISTORY_DEPTH
+      if(btn->m_gestureCount) btn->action(btn, Event_Gesture, menuLevel, btn->m_edgeUS);  // Matched when dispatched
+#endif
+
+      if(btn->m_blockKeyPress) {                                // A longPress, autoRepeat or chord, which isn't a click
+      } else if(!countsClicks() || (btn->m_clickCount == 0 && btn->clickLimit(menuLevel) <= 1)) {
+        btn->action(btn, Event_KeyPress, menuLevel, btn->m_edgeUS); // Nothing bound beyond a single click, so a keyPress straight away
+      } else {
+        if(btn->m_clickCount == 0) btn->m_clickMenuLevel = menuLevel; // Save menuLevel, the clicks are all actioned at the first one's
+        btn->m_clickCount++;
+        btn->m_clickUS = btn->m_edgeUS;
+        if(btn->m_clickCount >= btn->clickLimit(btn->m_clickMenuLevel)) {
+          killTimer(btn, Timer_DoubleClick);
+          clicksDone(btn);                                      // No higher count is bound, don't wait for one
+        } else {
+          startTimer(btn, Timer_DoubleClick, uint64_t(btn->m_doubleClickMS * 1000));  // Wait for another click to begin
+        }
+      }
+      ENTER_STATE(btn, Released);
+      btn->pinInterrupt(true);
+      break;
+    }
+  } // End of SWITCH statement
+
+  return;
+} // End of readButton function
+
+
+//-- Timer ISR debouncing (setTimerDispatch(ESP_TIMER_ISR)): sampling stays in the ISR, where its timing doesn't depend on
+// how busy the esp_timer task is, while everything that follows a confirmed change (events, chords, click counting and
+// the longPress timers) runs in task context from Timer_Classify, started to expire at once.
+bool IRAM_ATTR InterruptButton::deferClassify(InterruptButton* btn, buttonStates state){
+  if(!btn->m_isrDebounce) return false;
+  ENTER_STATE(btn, state);                                      // Pressing or Releasing, picked up by readButton() from Timer_Classify
+  startTimer(btn, Timer_Classify, 0);
+  return true;
+}
+
+void InterruptButton::classifyTimeout(void *arg){
+  InterruptButton* btn = reinterpret_cast<InterruptButton*>(arg);
+  useGuard guard(&btn->m_inUse);
+  if(btn->m_retiring) return;
+  readButton(btn);
+  if(btn->m_state != Pressed && btn->m_state != Released) return;
+  if(!btn->edgeTimestamped()) btn->pinInterrupt(false);         // So an edge can't start the checks below twice
+  bool moved = (btn->pinLevel() == btn->m_pressedState) != (btn->m_state == Pressed);
+  if(!moved) {                                                  // Still where it was confirmed, the interrupt watches for the next change
+    if(!btn->edgeTimestamped()) btn->pinInterrupt(true);
+  } else if(btn->edgeTimestamped()) {                           // Changed again while the events were sent, debounce it as a new edge
+    edgeCapture(btn);
+  } else {
+    readButton(btn);
+  }
+}
+
+//-- Method to capture an edge for Debounce_EdgeTimestamp (GPIO ISR), deciding is left to the settle timer --
+void IRAM_ATTR InterruptButton::edgeCapture(void *arg){
+  InterruptButton* btn = reinterpret_cast<InterruptButton*>(arg);
+  useGuard guard(&btn->m_inUse);
+  if(btn->m_retiring) return;
+  uint32_t nowUS = static_cast<uint32_t>(esp_timer_get_time());
+  btn->m_lastEdgeUS = nowUS;
+  STAT_COUNT(btn, edges);
+
+  switch(btn->m_state){
+    case Released:                                              // First edge of a possible press, one timer for the whole debounce
+      btn->m_blockKeyPress = false;
+      btn->m_edgeUS = nowUS;
+      ENTER_STATE(btn, ConfirmingPress);
+      startTimer(btn, Timer_Poll, btn->settleLookUS());
+      fastKeyDown(btn);
+      break;
+
+    case Pressed:                                               // First edge of a possible release
+      btn->m_edgeUS = nowUS;
+      ENTER_STATE(btn, WaitingForRelease);
+      startTimer(btn, Timer_Poll, btn->settleLookUS());
+      break;
+
+    default:                                                    // Still bouncing, the timestamp above is all that is needed
+      break;
+  }
+}
+
+//-- Debounce_Batched: port wide sampling, every batched button on a GPIO bank is debounced in one pass ----
+// Each pin has two vertical counters held as bit-planes across the bank's words, one counting consecutive samples
+// away from the pin's stable level and one counting samples at it.  Stepping them is a handful of bitwise operations
+// for all 32 pins at once.  TARGET_POLLS samples away confirms the edge, TARGET_POLLS back at it is a false alarm.
+static_assert(TARGET_POLLS >= 1 && TARGET_POLLS < (1 << IBTN_COUNTER_PLANES), "IBTN_COUNTER_PLANES can't count to TARGET_POLLS");
+
+void IRAM_ATTR InterruptButton::batchedEdge(void *arg){
+  InterruptButton* btn = reinterpret_cast<InterruptButton*>(arg);
+  useGuard guard(&btn->m_inUse);
+  if(btn->m_retiring) return;
+  btn->pinInterrupt(false);                                   // The bank's tick samples the pin until it is decided
+  STAT_COUNT(btn, edges);
+
+  switch(btn->m_state){
+    case Released:
+      btn->m_blockKeyPress = false;
+      btn->m_edgeUS = static_cast<uint32_t>(esp_timer_get_time());
+      ENTER_STATE(btn, ConfirmingPress);
+      fastKeyDown(btn);
+      break;
+
+    case Pressed:
+      btn->m_edgeUS = static_cast<uint32_t>(esp_timer_get_time());
+      ENTER_STATE(btn, WaitingForRelease);
+      break;
+
+    default:                                                  // Already being sampled
+      return;
+  }
+
+  bank_t &bank = m_banks[btn->m_pin >> 5];
+  portENTER_CRITICAL_SAFE(&m_bankMux);
+  bank.active |= 1UL << (btn->m_pin & 31);
+  if(!bank.deadline.armed) scheduleDeadline(bank.deadline, esp_timer_get_time() + bank.intervalUS);  // Otherwise join the next tick
+  portEXIT_CRITICAL_SAFE(&m_bankMux);
+}
+
+void InterruptButton::bankTick(void *arg){
+  bank_t &bank = *reinterpret_cast<bank_t*>(arg);
+  InterruptButton* decided[32];
+
+  portENTER_CRITICAL_SAFE(&m_bankMux);
+#if SOC_GPIO_PIN_COUNT > 32
+  uint32_t sample = (&bank != m_banks) ? REG_READ(GPIO_IN1_REG) : REG_READ(GPIO_IN_REG);  // One read for every pin on the bank
+#else
+  uint32_t sample = REG_READ(GPIO_IN_REG);                    // One read for every pin on the bank
+#endif
+  uint32_t away = (sample ^ bank.stable) & bank.active;
+  uint32_t changed = countSamples(bank.changeCount, away);
+  uint32_t quiet = countSamples(bank.quietCount, bank.active & ~away);
+  bank.stable ^= changed;
+  bank.active &= ~(changed | quiet);                          // Decided, these go back to their interrupts
+  for(uint32_t done = changed | quiet; done != 0; done &= done - 1) {
+    uint8_t bit = static_cast<uint8_t>(__builtin_ctz(done));
+    decided[bit] = bank.buttons[bit];                         // Claimed while leaveBank() can't run, so none goes meanwhile
+    if(decided[bit] != nullptr) decided[bit]->m_inUse.fetch_add(1, std::memory_order_seq_cst);
+  }
+  portEXIT_CRITICAL_SAFE(&m_bankMux);
+
+  for(uint32_t done = changed | quiet; done != 0; done &= done - 1) {
+    uint8_t bit = static_cast<uint8_t>(__builtin_ctz(done));
+    InterruptButton* btn = decided[bit];
+    if(btn == nullptr) continue;
+    useGuard guard(&btn->m_inUse, true);
+    if(btn->m_retiring) continue;
+    if(changed & (1UL << bit)) {                              // Confirmed, let the usual state handling send the events
+      ENTER_STATE(btn, (btn->m_state == ConfirmingPress) ? Pressing : Releasing);
+      readButton(btn);
+    } else {                                                  // Back where it started, so it was a false alarm
+      if(btn->m_state == ConfirmingPress) {
+        ENTER_STATE(btn, Released);
+        cancelFastKeyDown(btn);
+      } else {
+        ENTER_STATE(btn, Pressed);
+      }
+      STAT_COUNT(btn, falseAlarms);
+      btn->pinInterrupt(true);
+    }
+  }
+
+  portENTER_CRITICAL_SAFE(&m_bankMux);
+  if(bank.active != 0 && !bank.deadline.armed) scheduleDeadline(bank.deadline, esp_timer_get_time() + bank.intervalUS);
+  portEXIT_CRITICAL_SAFE(&m_bankMux);
+}
+
+uint32_t IRAM_ATTR InterruptButton::countSamples(uint32_t (&planes)[IBTN_COUNTER_PLANES], uint32_t bits){
+  uint32_t carry = bits;                                      // Add one to the counter of each bit set, clear the others
+  for(int p = 0; p < IBTN_COUNTER_PLANES; p++) {
+    uint32_t plane = planes[p];
+    planes[p] = (plane ^ carry) & bits;
+    carry &= plane;
+  }
+  uint32_t reached = bits;                                    // Counters now equal to TARGET_POLLS
+  for(int p = 0; p < IBTN_COUNTER_PLANES; p++) reached &= ((TARGET_POLLS >> p) & 1) ? planes[p] : ~planes[p];
+  for(int p = 0; p < IBTN_COUNTER_PLANES; p++) planes[p] &= ~reached;
+  return reached;
+}
+
+//-- Helpers for the optional fast keyDown, sent on the first edge and retracted if the press isn't confirmed
+void IRAM_ATTR InterruptButton::fastKeyDown(InterruptButton* btn){
+  btn->m_keyDownSent = false;
+  if(!btn->m_fastKeyDown) return;
+  btn->action(btn, Event_KeyDown);
+  btn->m_keyDownSent = true;
+}
+
+void IRAM_ATTR InterruptButton::cancelFastKeyDown(InterruptButton* btn){
+  if(!btn->m_keyDownSent) return;
+  btn->m_keyDownSent = false;
+  btn->action(btn, Event_KeyUp);                              // False alarm, so close off the early keyDown (no keyPress follows)
+}
+
+//-- Helper method to check for a quiet line, re-arms the settle timer for the remainder if not ----------
+bool IRAM_ATTR InterruptButton::lineSettled(InterruptButton* btn, uint32_t &edgeUS){
+  uint32_t nowUS = static_cast<uint32_t>(esp_timer_get_time());
+#if IBTN_HAS_PCNT
+  int count = 0;
+  if(btn->m_pulseCounterActive && pcnt_unit_get_count(btn->m_pcntUnit, &count) == ESP_OK && count != btn->m_pcntCount) {
+    btn->m_pcntCount = count;                                 // Counted edges since the last look, so it has only been quiet from now
+    btn->m_lastEdgeUS = nowUS;
+  }
+#endif
+  edgeUS = btn->m_lastEdgeUS;
+  uint32_t quietUS = nowUS - edgeUS;
+  if(quietUS < btn->m_debounceUS) {
+    uint32_t waitUS = btn->m_debounceUS - quietUS;
+    startTimer(btn, Timer_Poll, (waitUS < btn->settleLookUS()) ? waitUS : btn->settleLookUS());
+    return false;
+  }
+#if IBTN_HAS_PCNT
+  if(btn->m_pulseCounterActive) {                             // Back to 0, so the next edge reaches the watch point and interrupts
+    pcnt_unit_clear_count(btn->m_pcntUnit);
+    btn->m_pcntCount = 0;
+  }
+#endif
+  return true;
+}
+
+//-- Method to handle longKeyPresses (called by timer)----------------------------------------------------
+void InterruptButton::longPressEvent(void *arg){
+  InterruptButton* btn = reinterpret_cast<InterruptButton*>(arg);
+  useGuard guard(&btn->m_inUse);
+  if(btn->m_retiring) return;
+  if(btn->m_clickCount) clicksDone(btn);                                    // Held on the last of some clicks, those come first
+
+  btn->action(btn, Event_LongKeyPress, btn->menuLevel(), static_cast<uint32_t>(esp_timer_get_time())); // Add the long keypress action to the relevant queue
+  btn->m_blockKeyPress = true;                                              // Used to prevent regular keypress or doubleclick later on in procedure.
+  
+  //Initiate the autorepeat function
+  if(btn->eventEnabled(Event_AutoRepeatPress) && btn->pinLevel() == btn->m_pressedState) { // Sanity check to stop autorepeats in case we somehow missed button release
+    btn->m_autoRepeating = true;
+    startTimer(btn, Timer_LPandRepeat, uint64_t(btn->m_autoRepeatMS * 1000));
+  }
+}
+
+//-- Method to handle autoRepeatPresses (called by timer)-------------------------------------------------
+void InterruptButton::autoRepeatPressEvent(void *arg){
+  InterruptButton* btn = reinterpret_cast<InterruptButton*>(arg);
+  useGuard guard(&btn->m_inUse);
+  if(btn->m_retiring) return;
+  if(btn->m_clickCount) clicksDone(btn);
+  btn->m_blockKeyPress = true;                                              // Used to prevent regular keypress or doubleclick later on in procedure.
+  uint32_t nowUS = static_cast<uint32_t>(esp_timer_get_time());
+  uint8_t menuLevel = btn->menuLevel();
+
+  if(btn->actionBound(menuLevel, Event_AutoRepeatPress)) {
+    btn->action(btn, Event_AutoRepeatPress, menuLevel, nowUS, 1);           // Action the Async Auto Repeat KeyPress Event if defined
+  } else {
+    btn->action(btn, Event_KeyPress, menuLevel, nowUS);                     // Action the Async KeyPress Event otherwise
+  }
+  if(btn->eventEnabled(Event_AutoRepeatPress) && btn->pinLevel() == btn->m_pressedState) { // Sanity check to stop autorepeats in case we somehow missed button release
+    btn->m_autoRepeating = true;
+    startTimer(btn, Timer_LPandRepeat, uint64_t(btn->m_autoRepeatMS * 1000));
+  }
+}
+
+//-- Method to action the clicks counted so far once no further click began in time (called by timer) -----
+void InterruptButton::doubleClickTimeout(void *arg){
+  InterruptButton* btn = reinterpret_cast<InterruptButton*>(arg);
+  useGuard guard(&btn->m_inUse);
+  if(btn->m_retiring) return;
+  if(btn->m_clickCount) clicksDone(btn);                                    // Note, this timer is never started if previous press was a longpress
+}
+
+//-- Helper method to raise the event for the clicks counted: a keyPress, doubleClick or multiClick ---------
+void IRAM_ATTR InterruptButton::clicksDone(InterruptButton* btn){
+  uint8_t clicks = btn->m_clickCount;
+  btn->m_clickCount = 0;
+  if(clicks == 1) {
+    btn->action(btn, Event_KeyPress, btn->m_clickMenuLevel, btn->m_clickUS);        // At the menuLevel when the first click occurred
+  } else {                                                                          // Two are a multiClick too if no doubleClick is bound
+    bool doubleClick = clicks == 2 && btn->eventEnabled(Event_DoubleClick) && btn->actionBound(btn->m_clickMenuLevel, Event_DoubleClick);
+    btn->action(btn, doubleClick ? Event_DoubleClick : Event_MultiClick, btn->m_clickMenuLevel, btn->m_clickUS, clicks);
+  }
+}
+
+//-- Method to route the shared longPress/autoRepeat timer to the relevant handler (called by timer) ------
+void InterruptButton::longPressAndRepeatTimeout(void *arg){
+  InterruptButton* btn = reinterpret_cast<InterruptButton*>(arg);
+  if(btn->m_autoRepeating) {
+    autoRepeatPressEvent(arg);
+  } else {
+    longPressEvent(arg);
+  }
+}
+
+//-- Helper method to create a timer, done once per button so no heap activity occurs while debouncing ---
+bool InterruptButton::createTimer(esp_timer_handle_t &timer, void (*callBack)(void* arg), void* arg, const char *name,
+                                  esp_timer_dispatch_t dispatch){
+  esp_timer_create_args_t tmrConfig = {};
+    tmrConfig.arg = arg;
+    tmrConfig.callback = callBack;
+    tmrConfig.dispatch_method = dispatch;
+    tmrConfig.name = name;
+  esp_err_t err = esp_timer_create(&tmrConfig, &timer);
+  if(err != ESP_OK) {
+    ESP_LOGE(TAG, "createTimer(): Failed to create timer '%s', exit status: %d", name, err);
+    timer = nullptr;
+    return false;
+  }
+  return true;
+}
+
+//-- Helper method to simplify (re)starting one of a button's timers -------------------------------------
+void IRAM_ATTR InterruptButton::startTimer(InterruptButton* btn, buttonTimers timer, uint32_t duration_US){
+  if(btn->m_retiring) return;                                 // Its timers are being deleted
+  if(btn->m_usesScheduler) {
+    scheduleDeadline(btn->m_deadlines[timer], esp_timer_get_time() + duration_US);
+  } else if(btn->m_timers[timer] != nullptr) {
+    esp_timer_stop(btn->m_timers[timer]);                     // A one-shot timer can't be started if it's still running
+    esp_timer_start_once(btn->m_timers[timer], duration_US);
+  }
+}
+
+//-- Helper method to stop one of a button's timers ------------------------------------------------------
+void IRAM_ATTR InterruptButton::killTimer(InterruptButton* btn, buttonTimers timer){
+  if(btn->m_usesScheduler) {
+    cancelDeadline(btn->m_deadlines[timer]);
+  } else if(btn->m_timers[timer] != nullptr) {
+    esp_timer_stop(btn->m_timers[timer]);
+  }
+}
+
+//-- Helper method to release a timer --------------------------------------------------------------------
+void InterruptButton::deleteTimer(esp_timer_handle_t &timer){
+  if(timer){
+    esp_timer_stop(timer);
+    esp_timer_delete(timer);
+    timer = nullptr;
+  }
+}
+
+//-- Shared timer scheduler, one esp_timer for all buttons -----------------------------------------------
+// Armed deadlines are kept in a list sorted by due time and the hardware timer is always set for the head,
+// so the work done scales with the number of active deadlines rather than the number of buttons.
+void InterruptButton::setSharedTimers(bool shared){
+  m_sharedTimers = shared;
+}
+
+bool InterruptButton::getSharedTimers(void){
+  return m_sharedTimers;
+}
+
+//-- Dispatch of the debounce timers for buttons initialised afterwards.  ESP_TIMER_ISR keeps the sampling interval exact
+// under load, and applies to buttons with their own timers (not the shared scheduler or Debounce_Batched banks).
+bool InterruptButton::setTimerDispatch(esp_timer_dispatch_t method){
+#if IBTN_HAS_ISR_TIMERS
+  if(method == ESP_TIMER_TASK || method == ESP_TIMER_ISR) {
+    m_timerDispatch = method;
+    return true;
+  }
+  ESP_LOGE(TAG, "setTimerDispatch(): Invalid dispatch method specified!");
+#else
+  if(method == ESP_TIMER_TASK) return true;
+  ESP_LOGW(TAG, "setTimerDispatch(): ESP_TIMER_ISR isn't supported here (CONFIG_ESP_TIMER_SUPPORTS_ISR_DISPATCH_METHOD)");
+#endif
+  return false;
+}
+
+esp_timer_dispatch_t InterruptButton::getTimerDispatch(void){
+  return m_timerDispatch;
+}
+
+void IRAM_ATTR InterruptButton::scheduleDeadline(deadline_t &node, uint64_t dueUS){
+  portENTER_CRITICAL_SAFE(&m_schedulerMux);
+  unlinkDeadline(node);
+  node.dueUS = dueUS;
+  deadline_t** link = &m_schedulerHead;                       // Find the insertion point, keeping the list sorted
+  while(*link != nullptr && (*link)->dueUS <= dueUS) link = &(*link)->next;
+  node.next = *link;
+  *link = &node;
+  node.armed = true;
+  if(m_schedulerHead == &node) armScheduler();                // New earliest deadline, bring the hardware timer forward
+  portEXIT_CRITICAL_SAFE(&m_schedulerMux);
+}
+
+void IRAM_ATTR InterruptButton::cancelDeadline(deadline_t &node){
+  portENTER_CRITICAL_SAFE(&m_schedulerMux);
+  unlinkDeadline(node);                                       // The hardware timer is left alone, an early wake just finds nothing due
+  portEXIT_CRITICAL_SAFE(&m_schedulerMux);
+}
+
+void IRAM_ATTR InterruptButton::unlinkDeadline(deadline_t &node){   // Must hold m_schedulerMux
+  if(!node.armed) return;
+  for(deadline_t** link = &m_schedulerHead; *link != nullptr; link = &(*link)->next) {
+    if(*link == &node) {
+      *link = node.next;
+      break;
+    }
+  }
+  node.next = nullptr;
+  node.armed = false;
+}
+
+void IRAM_ATTR InterruptButton::armScheduler(void){                 // Must hold m_schedulerMux
+  if(m_schedulerTimer == nullptr || m_schedulerHead == nullptr) return;
+  int64_t waitUS = static_cast<int64_t>(m_schedulerHead->dueUS) - esp_timer_get_time();
+  esp_timer_stop(m_schedulerTimer);
+  esp_timer_start_once(m_schedulerTimer, (waitUS > 0) ? waitUS : 0);
+}
+
+void InterruptButton::schedulerTimeout([[maybe_unused]] void *arg){
+  while(1) {
+    portENTER_CRITICAL_SAFE(&m_schedulerMux);
+    deadline_t* node = m_schedulerHead;
+    if(node == nullptr || node->dueUS > static_cast<uint64_t>(esp_timer_get_time())) {
+      armScheduler();                                         // Nothing (more) due yet
+      portEXIT_CRITICAL_SAFE(&m_schedulerMux);
+      return;
+    }
+    unlinkDeadline(*node);
+    useGuard guard(node->inUse);                              // Before the lock goes: its owner cancels then waits for this
+    esp_timer_cb_t callback = node->callback;
+    void* cbArg = node->arg;
+    portEXIT_CRITICAL_SAFE(&m_schedulerMux);
+    callback(cbArg);                                          // Called outside the lock so it can schedule again
+  }
+}
+
+void IRAM_ATTR InterruptButton::action(InterruptButton* btn, events event, uint8_t menuLevel, uint32_t timestampUS, int16_t data){
+  if(btn->m_retiring)                                                         return;   // Being deleted, the queues have been purged
+  if(menuLevel >= btn->m_actionRows)                                          return;   // Invalid menu level
+  if(!btn->eventEnabled(event) || !btn->eventEnabled(Event_All))              return;   // Specific event is or all events are disabled
+  if(!btn->actionBound(menuLevel, event))                                     return;   // Event is not defined
+
+  bool coalesced = (event == Event_AutoRepeatPress && btn->m_coalesceRepeats) || event == Event_Rotate;
+  if(coalesced) {
+    if(!coalesce(btn, (event == Event_Rotate) ? data : 1))                    return;   // Counted against the entry already waiting
+    data = 0;                                                                           // The count is collected when it is dispatched
+  }
+
+  HISTORY(btn, History_Event, timestampUS, event, menuLevel);
+  ButtonEvent evt = { btn, event, menuLevel, data, timestampUS };                   // Small POD record, no copying of the action itself
+  if(m_mode == Mode_Asynchronous || (m_mode == Mode_Hybrid && (event == Event_KeyDown || event == Event_KeyUp))) {
+    uint8_t lane = btn->laneOf(event);
+    bool queued = m_asyncEventQueue[lane].push(evt);
+    TRACE(queued ? Trace_Enqueue : Trace_Drop, btn, event);
+    if(queued) notifyServicer(lane);                                 // Action immediatley using RTOS asynchronous Queue
+    else if(coalesced) uncoalesce(btn);                              // Keep the count, the next repeat tries again
+#if IBTN_STATS
+    countQueued(btn, &InterruptButtonStats::asyncQueue, queued, m_asyncEventQueue[lane].size());
+#endif
+  } else {                                                           // Action when called in main loop hook using synchronous Queue
+    bool queued = m_syncEventQueue.push(evt);
+    TRACE(queued ? Trace_Enqueue : Trace_Drop, btn, event);
+    if(!queued && coalesced) uncoalesce(btn);
+#if IBTN_STATS
+    countQueued(btn, &InterruptButtonStats::syncQueue, queued, m_syncEventQueue.size());
+#endif
+  }
+}
+
+//-- Coalesced autoRepeats and rotations: one queue entry at a time however slowly it is taken, so none are dropped
+bool IRAM_ATTR InterruptButton::coalesce(InterruptButton* btn, int16_t count){
+  portENTER_CRITICAL_SAFE(&m_repeatMux);
+  int32_t total = btn->m_pendingCount + count;
+  btn->m_pendingCount = static_cast<int16_t>((total > INT16_MAX) ? INT16_MAX : (total < -INT16_MAX) ? -INT16_MAX : total);
+  bool needsEntry = !btn->m_coalescedQueued;
+  btn->m_coalescedQueued = true;
+  portEXIT_CRITICAL_SAFE(&m_repeatMux);
+  return needsEntry;
+}
+
+void IRAM_ATTR InterruptButton::uncoalesce(InterruptButton* btn){    // Its entry wasn't queued after all, under the lock as
+  portENTER_CRITICAL_SAFE(&m_repeatMux);                             // an ISR on the other core may be adding to the count
+  btn->m_coalescedQueued = false;
+  portEXIT_CRITICAL_SAFE(&m_repeatMux);
+}
+
+
+//-- Chords, buttons held down together ------------------------------------------------------------------
+// Each button used in a chord has a bit in m_pressedMask, set while it is (debounced) down.  When a button goes
+// down the chords it belongs to are compared with the mask, so the cost depends on the number of chords, never the
+// number of buttons.  A chord matches when exactly its buttons are down, its buttons then send no keyPress,
+// longPress, autoRepeat or double-click for that press.
+int8_t InterruptButton::addChord(InterruptButton* const buttons[], uint8_t count){
+  if(count < 2 || buttons == nullptr) {
+    ESP_LOGE(TAG, "addChord(): A chord needs at least two buttons!");
+    return -1;
+  }
+  if(!compiledIn(Event_Chord)) {
+    ESP_LOGE(TAG, "addChord(): Event_Chord is not built in (IBTN_EVENTS)!");
+    return -1;
+  }
+  portENTER_CRITICAL_SAFE(&m_chordMux);
+  int8_t index = -1;
+  uint32_t mask = 0, assigned = 0;                            // Bits given out by this call, handed back if it fails
+  bool ok = m_numChords < IBTN_MAX_CHORDS;
+  for(uint8_t i = 0; ok && i < count; i++) {
+    InterruptButton* btn = buttons[i];
+    if(btn == nullptr) { ok = false; break; }
+    if(btn->m_chordBit == 0) {                                // First chord for this button, give it a free bit
+      uint8_t bit = 0;
+      while(bit < 32 && m_chordButtons[bit] != nullptr) bit++;
+      if(bit >= 32) { ok = false; break; }
+      btn->m_chordBit = 1UL << bit;
+      m_chordButtons[bit] = btn;
+      assigned |= btn->m_chordBit;
+    }
+    mask |= btn->m_chordBit;
+  }
+  if(ok) {
+    index = static_cast<int8_t>(m_numChords);
+    m_chords[m_numChords++] = { mask, buttons[0] };
+  } else {
+    for(uint32_t bits = assigned; bits != 0; bits &= bits - 1) {   // Leave no phantom members behind
+      uint8_t bit = static_cast<uint8_t>(__builtin_ctz(bits));
+      m_chordButtons[bit]->m_chordBit = 0;
+      m_chordButtons[bit] = nullptr;
+    }
+    m_pressedMask &= ~assigned;
+  }
+  portEXIT_CRITICAL_SAFE(&m_chordMux);
+  if(!ok) ESP_LOGE(TAG, "addChord(): The chord table is full (IBTN_MAX_CHORDS, 32 buttons), or a button is invalid!");
+  return index;
+}
+
+void InterruptButton::clearChords(void){
+  portENTER_CRITICAL_SAFE(&m_chordMux);
+  for(uint8_t b = 0; b < 32; b++) {
+    if(m_chordButtons[b] != nullptr) m_chordButtons[b]->m_chordBit = 0;
+    m_chordButtons[b] = nullptr;
+  }
+  m_numChords = 0;
+  m_pressedMask = 0;
+  portEXIT_CRITICAL_SAFE(&m_chordMux);
+}
+
+void IRAM_ATTR InterruptButton::chordPressed(InterruptButton* btn){
+  portENTER_CRITICAL_SAFE(&m_chordMux);
+  uint32_t pressed = m_pressedMask | btn->m_chordBit;
+  m_pressedMask = pressed;
+  int8_t chord = -1;
+  for(uint8_t c = 0; c < m_numChords; c++) {
+    if(m_chords[c].mask == pressed) { chord = static_cast<int8_t>(c); break; }
+  }
+  InterruptButton* owner = (chord >= 0) ? m_chords[chord].owner : nullptr;
+  InterruptButton* members[32];
+  for(uint32_t bits = (owner != nullptr) ? pressed : 0; bits != 0; bits &= bits - 1) {
+    uint8_t bit = static_cast<uint8_t>(__builtin_ctz(bits));
+    members[bit] = m_chordButtons[bit];                       // Claimed while leaveChords() can't run, so none goes meanwhile
+    if(members[bit] != nullptr) members[bit]->m_inUse.fetch_add(1, std::memory_order_seq_cst);
+  }
+  portEXIT_CRITICAL_SAFE(&m_chordMux);
+  if(owner == nullptr) return;
+
+  for(uint32_t bits = pressed; bits != 0; bits &= bits - 1) {
+    InterruptButton* member = members[__builtin_ctz(bits)];
+    if(member == nullptr) continue;
+    member->m_blockKeyPress = true;                           // The chord replaces the members' own press
+    if(member != btn) killTimer(member, Timer_LPandRepeat);   // btn hasn't started its own yet
+    if(member->m_clickCount) {
+      killTimer(member, Timer_DoubleClick);
+      member->m_clickCount = 0;
+    }
+  }
+  action(owner, Event_Chord, owner->menuLevel(), btn->m_edgeUS, chord);   // The owner is one of the members
+  for(uint32_t bits = pressed; bits != 0; bits &= bits - 1) {
+    InterruptButton* member = members[__builtin_ctz(bits)];
+    if(member != nullptr) member->m_inUse.fetch_sub(1, std::memory_order_release);
+  }
+}
+
+void IRAM_ATTR InterruptButton::chordReleased(InterruptButton* btn){
+  portENTER_CRITICAL_SAFE(&m_chordMux);
+  m_pressedMask &= ~btn->m_chordBit;
+  portEXIT_CRITICAL_SAFE(&m_chordMux);
+}
+
+void InterruptButton::leaveChords(void){
+  if(m_chordBit == 0) return;
+  portENTER_CRITICAL_SAFE(&m_chordMux);
+  uint8_t kept = 0;
+  for(uint8_t c = 0; c < m_numChords; c++) {                  // Later chords move down, so their indices change
+    if(!(m_chords[c].mask & m_chordBit)) m_chords[kept++] = m_chords[c];
+  }
+  m_numChords = kept;
+  m_chordButtons[__builtin_ctz(m_chordBit)] = nullptr;
+  m_pressedMask &= ~m_chordBit;
+  m_chordBit = 0;
+  portEXIT_CRITICAL_SAFE(&m_chordMux);
+}
+
+
+//-- Sleep, buttons that wake the chip and the press that did it -----------------------------------------
+// Idle buttons need no timer (and the servicers block on a notification) so the chip is free to sleep between
+// presses, but the edge that wakes it is never seen by the GPIO ISR.  resumeFromSleep() reads the wake cause and
+// replays it: a button still held is debounced as though its ISR had fired, and after a deep sleep a button that
+// is already down (or let go again) by the time it is set up is given its press straight away.
+bool InterruptButton::setWakeup(bool enabled){
+  if(enabled == m_wakeSource) return true;
+  if(!enabled) {
+    leaveWake();
+    return true;
+  }
+  if(matrixKey()) {
+    ESP_LOGE(TAG, "setWakeup(): Matrix keys can't wake the chip, use a column pin instead");
+    return false;
+  }
+  if(m_virtualSource) {
+    ESP_LOGE(TAG, "setWakeup(): An encoder's button has no pin to wake the chip");
+    return false;
+  }
+  if(m_numWakeButtons >= IBTN_MAX_WAKE_BUTTONS) {
+    ESP_LOGE(TAG, "setWakeup(): No more than %d wakeup buttons (IBTN_MAX_WAKE_BUTTONS)", IBTN_MAX_WAKE_BUTTONS);
+    return false;
+  }
+  m_wakeButtons[m_numWakeButtons++] = this;
+  m_wakeSource = true;
+  return true;
+}
+
+bool InterruptButton::getWakeup(void) { return m_wakeSource; }
+
+void InterruptButton::leaveWake(void){
+  if(!m_wakeSource) return;
+  uint8_t kept = 0;
+  for(uint8_t w = 0; w < m_numWakeButtons; w++) {
+    if(m_wakeButtons[w] != this) m_wakeButtons[kept++] = m_wakeButtons[w];
+  }
+  m_numWakeButtons = kept;
+  m_wakeSource = false;
+}
+
+void InterruptButton::leaveButtons(void){
+  portENTER_CRITICAL_SAFE(&m_buttonsMux);
+  for(InterruptButton** link = &m_firstButton; *link != nullptr; link = &(*link)->m_nextButton) {
+    if(*link == this) {
+      *link = m_nextButton;
+      break;
+    }
+  }
+  portEXIT_CRITICAL_SAFE(&m_buttonsMux);
+}
+
+// Every initialised button must be at rest, not just the wakeup ones: a button's own timers only run while it is
+// away from Released (debouncing, held for a longPress or autoRepeat) or counting clicks, and deadlines on the
+// shared scheduler (matrix scans and batched banks included) are all in its list.
+bool InterruptButton::prepareForSleep(bool deepSleep){
+  if(m_numWakeButtons == 0) {
+    ESP_LOGE(TAG, "prepareForSleep(): No button has been set up to wake the chip (setWakeup())");
+    return false;
+  }
+  bool idle = (m_schedulerHead == nullptr) && m_syncEventQueue.size() == 0;
+  for(auto &queue : m_asyncEventQueue) idle = idle && queue.size() == 0;
+  portENTER_CRITICAL_SAFE(&m_buttonsMux);
+  for(InterruptButton* btn = m_firstButton; btn != nullptr && idle; btn = btn->m_nextButton) {
+    idle = btn->m_state == Released && btn->m_clickCount == 0;
+  }
+  portEXIT_CRITICAL_SAFE(&m_buttonsMux);
+  if(!idle) {
+    ESP_LOGD(TAG, "prepareForSleep(): Buttons or their events are still being handled");
+    return false;
+  }
+  m_wakeReplayed = false;
+
+  if(!deepSleep) {                                            // Level wakeup, with the ISR off so the held button can't storm it on waking
+    for(uint8_t w = 0; w < m_numWakeButtons; w++) {
+      InterruptButton* btn = m_wakeButtons[w];
+      btn->pinInterrupt(false);
+      gpio_wakeup_enable(btn->m_pin, btn->m_pressedState ? GPIO_INTR_HIGH_LEVEL : GPIO_INTR_LOW_LEVEL);
+    }
+    m_lightSleepArmed = true;
+    return esp_sleep_enable_gpio_wakeup() == ESP_OK;
+  }
+
+#if SOC_PM_SUPPORT_EXT1_WAKEUP
+  uint64_t mask = 0;
+  uint8_t pressedState = m_wakeButtons[0]->m_pressedState;
+  for(uint8_t w = 0; w < m_numWakeButtons; w++) {
+    InterruptButton* btn = m_wakeButtons[w];
+    if(!esp_sleep_is_valid_wakeup_gpio(btn->m_pin)) {
+      ESP_LOGE(TAG, "prepareForSleep(): Pin %d can't wake the chip from deep sleep (not an RTC GPIO)", btn->m_pin);
+      return false;
+    }
+    if(btn->m_pressedState != pressedState) {
+      ESP_LOGE(TAG, "prepareForSleep(): Deep sleep wakeup buttons must all be pressed at the same level");
+      return false;
+    }
+    mask |= BIT64(btn->m_pin);
+    if(pressedState) {                                        // The digital pulls are off in deep sleep, use the RTC ones
+      rtc_gpio_pulldown_en(btn->m_pin);
+      rtc_gpio_pullup_dis(btn->m_pin);
+    } else {
+      rtc_gpio_pullup_en(btn->m_pin);
+      rtc_gpio_pulldown_dis(btn->m_pin);
+    }
+  }
+#if CONFIG_IDF_TARGET_ESP32
+  if(!pressedState && m_numWakeButtons > 1) ESP_LOGW(TAG, "prepareForSleep(): On the ESP32 active low buttons only wake it when all are pressed");
+#endif
+  esp_sleep_pd_config(ESP_PD_DOMAIN_RTC_PERIPH, ESP_PD_OPTION_ON);   // Keeps the RTC pulls powered
+  return esp_sleep_enable_ext1_wakeup(mask, pressedState ? ESP_EXT1_WAKEUP_ANY_HIGH
+                                                         : static_cast<esp_sleep_ext1_wakeup_mode_t>(0)) == ESP_OK; // All (ESP32) or any low
+#else
+  ESP_LOGE(TAG, "prepareForSleep(): This target has no ext1 wakeup for deep sleep");
+  return false;
+#endif
+}
+
+uint8_t InterruptButton::resumeFromSleep(void){
+  bool lightSleep = m_lightSleepArmed;
+  if(lightSleep) {                                            // Back to edge interrupts, gpio_wakeup_enable() changed the type
+    for(uint8_t w = 0; w < m_numWakeButtons; w++) {
+      gpio_wakeup_disable(m_wakeButtons[w]->m_pin);
+      gpio_set_intr_type(m_wakeButtons[w]->m_pin, GPIO_INTR_ANYEDGE);
+    }
+    m_lightSleepArmed = false;
+  }
+
+  uint64_t woken = 0;                                         // Pins that may have woken the chip
+  if(!m_wakeReplayed) {
+    switch(esp_sleep_get_wakeup_cause()) {
+      case ESP_SLEEP_WAKEUP_GPIO:                             // Light sleep, which doesn't say which pin
+        woken = ~0ULL;
+        break;
+#if SOC_PM_SUPPORT_EXT1_WAKEUP
+      case ESP_SLEEP_WAKEUP_EXT1:
+        woken = esp_sleep_get_ext1_wakeup_status();
+        break;
+#endif
+      default:
+        break;
+    }
+    m_wakeReplayed = true;
+  }
+
+  uint8_t replayed = 0;
+  for(uint8_t w = 0; w < m_numWakeButtons; w++) {
+    InterruptButton* btn = m_wakeButtons[w];
+    bool replay = (woken & BIT64(btn->m_pin)) && replayWake(btn, !lightSleep);
+    if(replay) replayed++;
+    if(lightSleep && (!replay || btn->edgeTimestamped())) btn->pinInterrupt(true);  // Otherwise the debounce turns it back on
+  }
+  return replayed;
+}
+
+bool InterruptButton::replayWake(InterruptButton* btn, bool deepSleep){
+  bool held = (btn->pinLevel() == btn->m_pressedState);
+  if(btn->m_state == Released && held) {                      // Still down, debounce it as though the edge had just been seen
+    btn->isrHandler()(btn);
+    return true;
+  }
+  if(!deepSleep || (btn->m_state != Released && btn->m_state != Pressed)) return false; // Let go already, or its ISR has it
+  btn->m_edgeUS = static_cast<uint32_t>(esp_timer_get_time());
+  btn->m_blockKeyPress = false;
+  ENTER_STATE(btn, Pressing);                                 // Initialised while held, yet the press is what woke the chip
+  readButton(btn);
+  if(!held) {                                                 // Released before the button was set up, so the whole press now
+    ENTER_STATE(btn, Releasing);
+    readButton(btn);
+  }
+  return true;
+}
+
+
+//-- History and gestures --------------------------------------------------------------------------------
+// Each button keeps a small ring of its debounced presses and releases and the events queued for it, recorded
+// where they happen (GPIO ISR or timer) with a spinlock and a copy, never allocating.  A gesture is a pattern of
+// short and long presses, each press following the last within the double-click time.  The ISR does no matching:
+// a release of a button with gestures queues an Event_Gesture, and the servicer (or main loop) looks back through
+// the history to that release when it dispatches it, so patterns need no timers of their own.
+#if IBTN_HISTORY_DEPTH
+void IRAM_ATTR InterruptButton::record(InterruptButton* btn, historyKinds kind, uint32_t timestampUS, events event, uint8_t menuLevel){
+  if(event == Event_Gesture) return;                          // Only known once matched
+  portENTER_CRITICAL_SAFE(&m_historyMux);
+  btn->m_history[btn->m_historyHead & (IBTN_HISTORY_DEPTH - 1)] = { timestampUS, kind, event, menuLevel };
+  if(++btn->m_historyHead == 0) btn->m_historyHead = IBTN_HISTORY_DEPTH;   // Same slot, but still known to be full
+  portEXIT_CRITICAL_SAFE(&m_historyMux);
+}
+
+uint8_t InterruptButton::getHistory(ButtonHistoryEntry entries[], uint8_t maxEntries){
+  portENTER_CRITICAL_SAFE(&m_historyMux);
+  uint16_t head = m_historyHead;
+  uint16_t count = (head < IBTN_HISTORY_DEPTH) ? head : IBTN_HISTORY_DEPTH;
+  if(count > maxEntries) count = maxEntries;                  // The latest ones
+  for(uint16_t i = 0; i < count; i++) entries[i] = m_history[(head - count + i) & (IBTN_HISTORY_DEPTH - 1)];
+  portEXIT_CRITICAL_SAFE(&m_historyMux);
+  return static_cast<uint8_t>(count);
+}
+
+void InterruptButton::clearHistory(void){
+  portENTER_CRITICAL_SAFE(&m_historyMux);
+  m_historyHead = 0;
+  portEXIT_CRITICAL_SAFE(&m_historyMux);
+}
+
+int8_t InterruptButton::addGesture(const char* pattern){
+  uint8_t steps = 0, longSteps = 0;
+  size_t length = (pattern == nullptr) ? 0 : strlen(pattern);
+  for(size_t i = 0; i < length && length <= 8; i++) {
+    if(pattern[i] != '.' && pattern[i] != '-') { length = 0; break; }
+    if(pattern[i] == '-') longSteps |= 1U << (length - 1 - i);  // Bit 0 is the last press
+    steps++;
+  }
+  if(steps == 0 || steps != length) {
+    ESP_LOGE(TAG, "addGesture(): A gesture is 1 to 8 presses, each '.' (short) or '-' (long)!");
+    return -1;
+  }
+  if(steps * 2 > IBTN_HISTORY_DEPTH) ESP_LOGW(TAG, "addGesture(): IBTN_HISTORY_DEPTH is too small to hold '%s'", pattern);
+  if(!m_thisButtonInitialised) initialiseInstance();
+  portENTER_CRITICAL_SAFE(&m_historyMux);
+  int8_t index = -1;
+  if(m_numGestures < IBTN_MAX_GESTURES) {
+    index = static_cast<int8_t>(m_numGestures);
+    m_gestures[m_numGestures++] = { this, steps, longSteps };
+    m_gestureCount++;
+  }
+  portEXIT_CRITICAL_SAFE(&m_historyMux);
+  if(index < 0) ESP_LOGE(TAG, "addGesture(): The gesture table is full (IBTN_MAX_GESTURES)!");
+  return index;
+}
+
+void InterruptButton::clearGestures(void){
+  portENTER_CRITICAL_SAFE(&m_historyMux);
+  for(uint8_t g = 0; g < m_numGestures; g++) m_gestures[g].owner->m_gestureCount = 0;
+  m_numGestures = 0;
+  portEXIT_CRITICAL_SAFE(&m_historyMux);
+}
+
+int8_t InterruptButton::matchGesture(InterruptButton* btn, uint32_t releaseUS){
+  ButtonHistoryEntry history[IBTN_HISTORY_DEPTH];
+  int count = btn->getHistory(history, IBTN_HISTORY_DEPTH);
+  int i = count - 1;
+  while(i >= 0 && !(history[i].kind == History_Release && history[i].timestampUS == releaseUS)) i--;  // Later presses aren't part of it
+
+  uint32_t gapUS = btn->m_doubleClickMS * 1000UL, longUS = btn->m_longKeyPressMS * 1000UL;
+  uint32_t upUS = 0, downUS = 0;
+  uint8_t steps = 0, longSteps = 0;
+  bool released = false, started = false;
+  for(; i >= 0 && steps <= 8; i--) {                          // Back through the presses, to a pause longer than the double-click time
+    if(history[i].kind == History_Release) {
+      if(steps > 0 && downUS - history[i].timestampUS > gapUS) { started = true; break; }
+      upUS = history[i].timestampUS;
+      released = true;
+    } else if(history[i].kind == History_Press && released) {
+      if(steps < 8 && upUS - history[i].timestampUS >= longUS) longSteps |= 1U << steps;
+      steps++;
+      downUS = history[i].timestampUS;
+      released = false;
+    }
+  }
+  if(i < 0) started = count < IBTN_HISTORY_DEPTH;             // Back to the first entry, unless older ones were overwritten
+  if(!started || steps == 0 || steps > 8) return -1;
+
+  int8_t index = -1;
+  portENTER_CRITICAL_SAFE(&m_historyMux);
+  for(uint8_t g = 0; g < m_numGestures; g++) {
+    const gesture_t &gesture = m_gestures[g];
+    if(gesture.owner == btn && gesture.steps == steps && gesture.longSteps == longSteps) { index = static_cast<int8_t>(g); break; }
+  }
+  portEXIT_CRITICAL_SAFE(&m_historyMux);
+  return index;
+}
+#endif
+
+void InterruptButton::leaveGestures(void){
+#if IBTN_HISTORY_DEPTH
+  if(m_gestureCount == 0) return;
+  portENTER_CRITICAL_SAFE(&m_historyMux);
+  uint8_t kept = 0;
+  for(uint8_t g = 0; g < m_numGestures; g++) {                // Later gestures move down, so their indices change
+    if(m_gestures[g].owner != this) m_gestures[kept++] = m_gestures[g];
+  }
+  m_numGestures = kept;
+  m_gestureCount = 0;
+  portEXIT_CRITICAL_SAFE(&m_historyMux);
+#endif
+}
+
+
+#if IBTN_STATS
+//-- Optional instrumentation, counted for both the button and the class under one spinlock (ISR safe) ---
+void IRAM_ATTR InterruptButton::countStat(InterruptButton* btn, uint32_t InterruptButtonStats::*counter){
+  portENTER_CRITICAL_SAFE(&m_statsMux);
+  (btn->m_stats.*counter)++;
+  (m_classStats.*counter)++;
+  portEXIT_CRITICAL_SAFE(&m_statsMux);
+}
+
+void IRAM_ATTR InterruptButton::countQueued(InterruptButton* btn, InterruptButtonQueueStats InterruptButtonStats::*queue,
+                                            bool queued, uint16_t waiting){
+  portENTER_CRITICAL_SAFE(&m_statsMux);
+  InterruptButtonQueueStats* counters[2] = { &(btn->m_stats.*queue), &(m_classStats.*queue) };
+  for(InterruptButtonQueueStats* q : counters) {
+    if(queued) q->enqueued++; else q->dropped++;
+    if(waiting > q->highWater) q->highWater = waiting;
+  }
+  portEXIT_CRITICAL_SAFE(&m_statsMux);
+}
+
+void InterruptButton::countDispatch(InterruptButton* btn, uint32_t latencyUS){
+  portENTER_CRITICAL_SAFE(&m_statsMux);
+  addLatency(btn->m_stats, latencyUS);
+  addLatency(m_classStats, latencyUS);
+  portEXIT_CRITICAL_SAFE(&m_statsMux);
+}
+
+void InterruptButton::addLatency(InterruptButtonStats &stats, uint32_t latencyUS){
+  if(stats.dispatched == 0 || latencyUS < stats.latencyMinUS) stats.latencyMinUS = latencyUS;
+  if(latencyUS > stats.latencyMaxUS) stats.latencyMaxUS = latencyUS;
+  stats.latencySumUS += latencyUS;
+  stats.dispatched++;
+}
+
+InterruptButtonStats InterruptButton::getStats(void){
+  portENTER_CRITICAL_SAFE(&m_statsMux);
+  InterruptButtonStats stats = m_classStats;
+  portEXIT_CRITICAL_SAFE(&m_statsMux);
+  return stats;
+}
+
+void InterruptButton::resetStats(void){
+  portENTER_CRITICAL_SAFE(&m_statsMux);
+  m_classStats = {};
+  portEXIT_CRITICAL_SAFE(&m_statsMux);
+}
+
+InterruptButtonStats InterruptButton::getButtonStats(void){
+  portENTER_CRITICAL_SAFE(&m_statsMux);
+  InterruptButtonStats stats = m_stats;
+  portEXIT_CRITICAL_SAFE(&m_statsMux);
+  return stats;
+}
+
+void InterruptButton::resetButtonStats(void){
+  portENTER_CRITICAL_SAFE(&m_statsMux);
+  m_stats = {};
+  portEXIT_CRITICAL_SAFE(&m_statsMux);
+}
+#endif
+
+
+
+//-- CLASS MEMBERS AND METHODS SPECIFIC TO A SINGLE INSTANCE (BUTTON) ------------------------------------
+//--------------------------------------------------------------------------------------------------------
+//--------------------------------------------------------------------------------------------------------
+//--------------------------------------------------------------------------------------------------------
+
+// Class object control and setup functions -------------------------------------
+// ------------------------------------------------------------------------------
+
+// Constructor ------------------------------------------------------------------
+InterruptButton::InterruptButton(uint8_t pin, uint8_t pressedState, gpio_mode_t pinMode,
+                                 uint16_t longKeyPressMS, uint16_t autoRepeatMS, 
+                                 uint16_t doubleClickMS,  uint32_t debounceUS) :
+                                 m_pressedState(pressedState),
+                                 m_pinMode(pinMode),
+                                 m_longKeyPressMS(longKeyPressMS),
+                                 m_autoRepeatMS(autoRepeatMS),
+                                 m_doubleClickMS(doubleClickMS),
+                                 m_debounceUS(debounceUS) {
+
+  if (GPIO_IS_VALID_GPIO(pin))                  // Check for a valid pin first
+    m_pin = static_cast<gpio_num_t>(pin);
+  else {
+    ESP_LOGW(TAG, "%d is not valid gpio on this platform", pin);
+    m_pin = static_cast<gpio_num_t>(-1);        //GPIO_NUM_NC (enum not showing up as defined);
+  }
+  m_pollIntervalUS = (debounceUS / TARGET_POLLS > 65535) ? 65535 : debounceUS / TARGET_POLLS;
+}
+
+// Matrix key constructor, the key is pressed while its bit in the matrix's key map is set
+InterruptButton::InterruptButton(const volatile uint32_t* levelWord, uint32_t levelMask,
+                                 uint16_t longKeyPressMS, uint16_t autoRepeatMS,
+                                 uint16_t doubleClickMS,  uint32_t debounceUS) :
+                                 m_pin(static_cast<gpio_num_t>(-1)),
+                                 m_pressedState(1),
+                                 m_pinMode(GPIO_MODE_DISABLE),
+                                 m_debounceMode(Debounce_EdgeTimestamp),     // Only sampled edges are seen, so timestamping is the one that fits
+                                 m_levelWord(levelWord),
+                                 m_levelMask(levelMask),
+                                 m_longKeyPressMS(longKeyPressMS),
+                                 m_autoRepeatMS(autoRepeatMS),
+                                 m_doubleClickMS(doubleClickMS),
+                                 m_debounceUS(debounceUS) {
+  m_pollIntervalUS = (debounceUS / TARGET_POLLS > 65535) ? 65535 : debounceUS / TARGET_POLLS;
+}
+
+// Virtual source constructor, carries another object's events (ie Event_Rotate) through the queues and bindings.
+// It is never pressed, so it needs no pin, timers or scheduler, and none of the matrix key paths apply to it.
+InterruptButton::InterruptButton(virtualSource_t) :
+                                 m_pin(static_cast<gpio_num_t>(-1)),
+                                 m_pressedState(1),
+                                 m_pinMode(GPIO_MODE_DISABLE),
+                                 m_virtualSource(true),
+                                 m_longKeyPressMS(750),
+                                 m_autoRepeatMS(250),
+                                 m_doubleClickMS(333),
+                                 m_debounceUS(0) {
+  m_pollIntervalUS = 0;
+}
+
+// Destructor --------------------------------------------------------------------
+// Only this button stops: its callbacks see m_retiring and return, every other button carries on.  Anything that
+// got past that check (on the other core, or in the esp_timer task) holds a useGuard on this button, so it waits for
+// a moment with none of its own before tearing down, and again once its timers are stopped and its queued events
+// purged.  Other buttons' callbacks are never waited for, however busy they are.
+InterruptButton::~InterruptButton() {
+  m_retiring = true;
+  std::atomic_thread_fence(std::memory_order_seq_cst);
+  if(ownPin()) gpio_isr_handler_remove(m_pin);
+  waitUnused(m_inUse);                                        // Anything queueing its events has done so, ready to purge
+  disableGlitchFilter();
+  disablePulseCounter();
+  if(m_debounceMode == Debounce_Batched) leaveBank();
+  leaveChords();
+  leaveWake();
+  leaveButtons();
+  leaveGestures();
+  auto purge = [this](ButtonEvent &evt){ if(evt.button == this) evt.button = nullptr; };  // Don't let queued events reference this button
+  for(auto &queue : m_asyncEventQueue) queue.forEachPending(purge);
+#if IBTN_MAX_WORKERS > 1
+  for(auto &lane : m_workers) {
+    for(worker_t &worker : lane) worker.handoff.forEachPending(purge);
+  }
+#endif
+  m_syncEventQueue.forEachPending(purge);
+  for(int tmr = 0; tmr < NumTimers; tmr++) killTimer(this, static_cast<buttonTimers>(tmr));
+  waitUnused(m_inUse);
+  for(int tmr = 0; tmr < NumTimers; tmr++) deleteTimer(m_timers[tmr]);
+  if(ownPin()) gpio_reset_pin(m_pin);
+
+  if(eventActions != nullptr) {
+    for(int i = 0; i < m_actionRows * NumEventTypes; i++) releaseAction(eventActions[i]);
+    if(m_ownsActions) delete [] eventActions;
+  }
+  if(m_arena != nullptr && m_arena->users.fetch_sub(1, std::memory_order_acq_rel) == 1) {   // Last of its group
+    delete [] m_arena->actions;
+    delete m_arena;
+  }
+}
+
+// Waits on one object's guards only (a button's, or a keypad's scans).  Never call it holding a guard on that object.
+void InterruptButton::waitUnused(const std::atomic<uint32_t> &inUse){
+  while(inUse.load(std::memory_order_seq_cst) != 0) vTaskDelay(1);     // Callbacks are short, and the deleting task lets them run
+}
+
+void IRAM_ATTR InterruptButton::claim(ButtonEvent &evt){
+  if(evt.button != nullptr) evt.button->m_inUse.fetch_add(1, std::memory_order_seq_cst);
+}
+
+// Caller provided action table (InterruptButtonT), must be done before initialising
+void InterruptButton::useActionStorage(boundAction_t* storage, uint8_t menus){
+  if(m_thisButtonInitialised) return;
+  eventActions = storage;
+  m_actionRows = menus;
+  m_ownsActions = false;
+}
+
+// Initialiser -------------------------------------------------------------------
+bool InterruptButton::initialiseClass(void){
+    if(!m_classInitialised){                    // We must be initialising the first button
+      if(m_numMenus == 0) m_numMenus = 1;       // Default to a single menu level if not set prior to initialising first button
+#if IBTN_TRACE == 1
+      SEGGER_SYSVIEW_RegisterModule(&traceModule);
+#endif
+      esp_err_t err = gpio_install_isr_service(ESP_INTR_FLAG_DEFAULT);
+      if(err != ESP_OK) ESP_LOGD(TAG, "GPIO ISR service installed with exit status: %d", err);
+      m_classInitialised = setMode(m_mode) && (err == ESP_OK || err == ESP_ERR_INVALID_STATE);
+    }
+    return m_classInitialised;
+}
+
+void InterruptButton::initialiseInstance(void){
+    if(m_thisButtonInitialised) return;
+    prepareInstance();
+    if(ownPin()) {                                          // Configure the interrupt associated with the pin
+      gpio_config_t gpio_conf = pinConfig(BIT64(static_cast<uint8_t>(m_pin)));
+      gpio_config(&gpio_conf);
+    }
+    attachPin();
+}
+
+void InterruptButton::prepareInstance(void){
+    initialiseClass();
+
+    if(eventActions == nullptr) {                           // Define the array of actions associated with each button (single block)
+      m_actionRows = m_singleMenu ? 1 : m_numMenus;
+      eventActions = new boundAction_t[m_actionRows * NumEventTypes];
+      m_ownsActions = true;
+    }
+    for(int i = 0; i < m_actionRows * NumEventTypes; i++) eventActions[i] = { nullptr, nullptr };
+    if(m_ownMenuLevel >= m_actionRows) {                    // setButtonMenuLevel() before the menus were known
+      ESP_LOGE(TAG, "Button menu level '%d' must be < the button's number of menus (%d)", m_ownMenuLevel, m_actionRows);
+      m_ownMenuLevel = -1;
+    }
+    static const char* const timerNames[NumTimers] = { "IBTN_poll", "IBTN_lpRpt", "IBTN_dblClk", "IBTN_class" };
+    m_usesScheduler = m_sharedTimers || matrixKey();        // Matrix keys always share the scheduler
+    if(m_usesScheduler) startScheduler();
+#if IBTN_HAS_ISR_TIMERS
+    m_isrDebounce = !m_usesScheduler && m_timerDispatch == ESP_TIMER_ISR;
+#endif
+    for(int tmr = 0; tmr < NumTimers; tmr++) {              // Timers are created once and reused for every event until the button is deleted
+      m_deadlines[tmr] = { 0, nullptr, timerCallback(static_cast<buttonTimers>(tmr)), this, false, &m_inUse };
+      if(m_usesScheduler || m_virtualSource || (tmr == Timer_Classify && !m_isrDebounce)) continue;
+      createTimer(m_timers[tmr], timerCallback(static_cast<buttonTimers>(tmr)), this, timerNames[tmr],
+                  (tmr == Timer_Poll && m_isrDebounce) ? m_timerDispatch : ESP_TIMER_TASK);
+    }
+
+}
+
+gpio_config_t InterruptButton::pinConfig(uint64_t pinMask){
+    gpio_config_t gpio_conf = {};
+      gpio_conf.mode = m_pinMode;
+      gpio_conf.pin_bit_mask = pinMask;
+      gpio_conf.pull_down_en = (m_pressedState) ? GPIO_PULLDOWN_ENABLE : GPIO_PULLDOWN_DISABLE;
+      gpio_conf.pull_up_en =   (m_pressedState) ? GPIO_PULLUP_DISABLE : GPIO_PULLUP_ENABLE;
+      gpio_conf.intr_type = GPIO_INTR_ANYEDGE;
+    return gpio_conf;
+}
+
+void InterruptButton::attachPin(void){
+    portENTER_CRITICAL_SAFE(&m_buttonsMux);               // Listed for prepareForSleep()
+    m_nextButton = m_firstButton;
+    m_firstButton = this;
+    portEXIT_CRITICAL_SAFE(&m_buttonsMux);
+    if(matrixKey()) {                                       // No pin of its own, the matrix scan calls edgeCapture()
+      m_state = (pinLevel() == m_pressedState) ? Pressed : Released;
+      m_thisButtonInitialised = true;
+      return;
+    }
+    if(m_virtualSource) {                                   // Nothing to attach, it is never pressed
+      m_state = Released;
+      m_thisButtonInitialised = true;
+      return;
+    }
+    if(m_debounceMode == Debounce_Hardware) enableGlitchFilter();
+    if(m_debounceMode == Debounce_PulseCounter) enablePulseCounter();
+    gpio_isr_handler_add(m_pin, isrHandler(), reinterpret_cast<void*>(this));
+    m_state = (gpio_get_level(m_pin) == m_pressedState) ? Pressed : Released;     // Set to current state when initialising
+    if(m_debounceMode == Debounce_Batched) joinBank();
+    m_thisButtonInitialised = true;
+}
+
+//-- Initialise a board's worth of buttons together (ie at boot).  Their action tables are carved from one allocation,
+// pins with the same mode and pull are configured by a single gpio_config() call, then every handler is installed.
+// Buttons already initialised (or given their own table by InterruptButtonT) are left as they are.
+bool InterruptButton::beginGroup(InterruptButton* const buttons[], uint8_t count){
+  if(buttons == nullptr || count == 0) {
+    ESP_LOGE(TAG, "beginGroup(): No buttons given!");
+    return false;
+  }
+  initialiseClass();
+  auto pending = [&](uint8_t i) {                             // Still to be initialised, and not listed earlier
+    if(buttons[i] == nullptr || buttons[i]->m_thisButtonInitialised) return false;
+    for(uint8_t j = 0; j < i; j++) if(buttons[j] == buttons[i]) return false;
+    return true;
+  };
+  auto rows = [](InterruptButton* btn) -> uint8_t { return btn->m_singleMenu ? 1 : m_numMenus; };
+
+  uint32_t total = 0;
+  uint8_t users = 0;
+  for(uint8_t i = 0; i < count; i++) {
+    if(!pending(i) || buttons[i]->eventActions != nullptr) continue;
+    total += rows(buttons[i]) * NumEventTypes;
+    users++;
+  }
+  if(total > 0) {                                             // One block for all the tables
+    actionArena_t* arena = new actionArena_t{ new boundAction_t[total], { users } };
+    uint32_t offset = 0;
+    for(uint8_t i = 0; i < count; i++) {
+      InterruptButton* btn = buttons[i];
+      if(!pending(i) || btn->eventActions != nullptr) continue;
+      btn->m_actionRows = rows(btn);
+      btn->eventActions = &arena->actions[offset];
+      btn->m_arena = arena;
+      offset += btn->m_actionRows * NumEventTypes;
+    }
+  }
+
+  bool retVal = true;
+  uint64_t configured = 0;
+  for(uint8_t i = 0; i < count; i++) {
+    if(!pending(i)) continue;
+    InterruptButton* btn = buttons[i];
+    btn->prepareInstance();
+    if(!btn->ownPin() || btn->m_pin < 0) continue;
+    if(configured & BIT64(static_cast<uint8_t>(btn->m_pin))) continue;
+    uint64_t mask = 0;                                        // Every pin still to do that is set up the same way
+    for(uint8_t j = i; j < count; j++) {
+      InterruptButton* other = buttons[j];
+      if(pending(j) && other->ownPin() && other->m_pin >= 0 &&
+         other->m_pinMode == btn->m_pinMode && other->m_pressedState == btn->m_pressedState) {
+        mask |= BIT64(static_cast<uint8_t>(other->m_pin));
+      }
+    }
+    gpio_config_t gpio_conf = btn->pinConfig(mask & ~configured);
+    if(gpio_config(&gpio_conf) != ESP_OK) {
+      ESP_LOGE(TAG, "beginGroup(): Failed to configure gpio mask 0x%llx", static_cast<unsigned long long>(gpio_conf.pin_bit_mask));
+      retVal = false;
+    }
+    configured |= mask;
+  }
+  for(uint8_t i = 0; i < count; i++) {
+    if(pending(i)) buttons[i]->attachPin();
+  }
+  return retVal;
+}
+
+bool InterruptButton::startScheduler(void){
+  if(m_schedulerTimer == nullptr) createTimer(m_schedulerTimer, &schedulerTimeout, nullptr, "IBTN_sched");
+  return m_schedulerTimer != nullptr;
+}
+
+
+//-- DEBOUNCE ALGORITHM SELECTION ------------------------------------------------------------------------
+// On a live button a debounce part way through is abandoned: its timers are stopped, the button goes back to the
+// last state it confirmed, and if the pin has moved from that since, the new algorithm debounces it as a fresh edge.
+void InterruptButton::setDebounceMode(debounceModes mode){
+  if(mode == m_debounceMode || !ownPin()) return;            // Matrix keys are always edge timestamped, a virtual source has nothing to debounce
+  if(m_thisButtonInitialised && m_debounceMode == Debounce_Batched) leaveBank();
+  m_debounceMode = mode;
+  if(m_thisButtonInitialised) {                               // Swap the filter and GPIO ISR over to suit the new algorithm
+    gpio_isr_handler_remove(m_pin);
+    killTimer(this, Timer_Poll);                              // The old algorithm's sampling or settle time, and its deferred classify
+    killTimer(this, Timer_Classify);
+    if(m_state == ConfirmingPress || m_state == Pressing) {   // Not yet confirmed, so still released
+      ENTER_STATE(this, Released);
+      cancelFastKeyDown(this);
+    } else if(m_state == WaitingForRelease || m_state == Releasing) {
+      ENTER_STATE(this, Pressed);
+    }
+    m_validPolls = 0; m_totalPolls = 0;
+    if(m_debounceMode == Debounce_Hardware) enableGlitchFilter(); else disableGlitchFilter();
+    if(m_debounceMode == Debounce_PulseCounter) enablePulseCounter(); else disablePulseCounter();
+    if(m_debounceMode == Debounce_Batched) joinBank();
+    gpio_isr_handler_add(m_pin, isrHandler(), reinterpret_cast<void*>(this));
+    pinInterrupt(true);                                       // Stays off while the pulse counter has the pin
+    if((gpio_get_level(m_pin) == m_pressedState) != (m_state == Pressed)) isrHandler()(this);   // Moved while switching over
+  }
+}
+
+// Hardware glitch filter (ESP32-S3/C6/H2 etc). Mechanical bounce lasts far longer than any filter window, so the
+// filter removes the fast glitches and the edge timestamp algorithm takes care of the rest with a single timer.
+bool InterruptButton::enableGlitchFilter(void){
+#if IBTN_HAS_GLITCH_FILTER
+  if(m_glitchFilterActive) return true;
+  esp_err_t err = ESP_FAIL;
+#if SOC_GPIO_FLEX_GLITCH_FILTER_NUM > 0
+  gpio_flex_glitch_filter_config_t filterConfig = {};
+    filterConfig.clk_src = GLITCH_FILTER_CLK_SRC_DEFAULT;
+    filterConfig.gpio_num = m_pin;
+    filterConfig.window_width_ns = IBTN_GLITCH_FILTER_NS;
+    filterConfig.window_thres_ns = IBTN_GLITCH_FILTER_NS;
+  err = gpio_new_flex_glitch_filter(&filterConfig, &m_glitchFilter);
+#endif
+#if SOC_GPIO_SUPPORT_PIN_GLITCH_FILTER
+  if(m_glitchFilter == nullptr) {                             // No flex filter free (or none on this target), use the fixed pin filter
+    gpio_pin_glitch_filter_config_t pinFilterConfig = {};
+      pinFilterConfig.clk_src = GLITCH_FILTER_CLK_SRC_DEFAULT;
+      pinFilterConfig.gpio_num = m_pin;
+    err = gpio_new_pin_glitch_filter(&pinFilterConfig, &m_glitchFilter);
+  }
+#endif
+  if(err == ESP_OK) err = gpio_glitch_filter_enable(m_glitchFilter);
+  if(err != ESP_OK) {
+    ESP_LOGW(TAG, "Hardware glitch filter unavailable on gpio %d (%d), using software debounce", m_pin, err);
+    disableGlitchFilter();
+    return false;
+  }
+  m_glitchFilterActive = true;
+  return true;
+#else
+  return false;                                               // Original ESP32 etc, Debounce_Hardware falls back to polling
+#endif
+}
+
+// Debounce_Batched membership, the bank's tick is a deadline on the shared scheduler whatever the button's own timers
+void InterruptButton::joinBank(void){
+  if(!GPIO_IS_VALID_GPIO(m_pin) || !startScheduler()) {
+    ESP_LOGE(TAG, "Unable to batch gpio %d, the shared scheduler is unavailable", m_pin);
+    return;
+  }
+  bank_t &bank = m_banks[m_pin >> 5];
+  uint32_t bit = 1UL << (m_pin & 31);
+  portENTER_CRITICAL_SAFE(&m_bankMux);
+  if(bank.members == 0) {
+    bank.deadline = { 0, nullptr, &bankTick, reinterpret_cast<void*>(&bank), false, nullptr };   // Banks are never deleted
+    bank.intervalUS = m_pollIntervalUS;
+  }
+  if(m_pollIntervalUS < bank.intervalUS) bank.intervalUS = m_pollIntervalUS;
+  if(bank.intervalUS == 0) bank.intervalUS = 1;
+  bank.buttons[m_pin & 31] = this;
+  bank.members |= bit;
+  if((m_state == Pressed) == (m_pressedState != 0)) bank.stable |= bit; else bank.stable &= ~bit;   // The level last confirmed
+  portEXIT_CRITICAL_SAFE(&m_bankMux);
+}
+
+void InterruptButton::leaveBank(void){
+  if(!GPIO_IS_VALID_GPIO(m_pin)) return;
+  bank_t &bank = m_banks[m_pin >> 5];
+  uint32_t bit = 1UL << (m_pin & 31);
+  portENTER_CRITICAL_SAFE(&m_bankMux);
+  if(bank.members & bit) {
+    bank.members &= ~bit;
+    bank.active &= ~bit;
+    for(int p = 0; p < IBTN_COUNTER_PLANES; p++) {
+      bank.changeCount[p] &= ~bit;
+      bank.quietCount[p] &= ~bit;
+    }
+    bank.buttons[m_pin & 31] = nullptr;
+    if(bank.members == 0) cancelDeadline(bank.deadline);
+  }
+  portEXIT_CRITICAL_SAFE(&m_bankMux);
+}
+
+// Pulse counter (ESP32, S2, S3, C6, H2...).  The PCNT counts every edge through its own glitch filter, and only its
+// watch point at a count of 1 interrupts, so an edge storm costs one interrupt.  The settle timer then compares counts
+// rather than ISR timestamps (the edge timestamp algorithm), and clears the count once the line has settled.
+bool InterruptButton::enablePulseCounter(void){
+#if IBTN_HAS_PCNT
+  if(m_pulseCounterActive) return true;
+  pcnt_unit_config_t unitConfig = {};
+    unitConfig.low_limit = -1;
+    unitConfig.high_limit = INT16_MAX;                        // Wraps to 0 and interrupts again after this many edges
+  pcnt_glitch_filter_config_t filterConfig = {};
+    filterConfig.max_glitch_ns = IBTN_GLITCH_FILTER_NS;
+  pcnt_chan_config_t chanConfig = {};
+    chanConfig.edge_gpio_num = m_pin;
+    chanConfig.level_gpio_num = -1;
+  pcnt_event_callbacks_t callbacks = {};
+    callbacks.on_reach = &pulseWatch;
+  esp_err_t err = pcnt_new_unit(&unitConfig, &m_pcntUnit);
+  if(err == ESP_OK) err = pcnt_unit_set_glitch_filter(m_pcntUnit, &filterConfig);
+  if(err == ESP_OK) err = pcnt_new_channel(m_pcntUnit, &chanConfig, &m_pcntChannel);
+  if(err == ESP_OK) err = pcnt_channel_set_edge_action(m_pcntChannel, PCNT_CHANNEL_EDGE_ACTION_INCREASE, PCNT_CHANNEL_EDGE_ACTION_INCREASE);
+  if(err == ESP_OK) err = pcnt_unit_add_watch_point(m_pcntUnit, 1);
+  if(err == ESP_OK) err = pcnt_unit_register_event_callbacks(m_pcntUnit, &callbacks, this);
+  if(err == ESP_OK) err = pcnt_unit_enable(m_pcntUnit);
+  if(err == ESP_OK) err = pcnt_unit_clear_count(m_pcntUnit);
+  if(err == ESP_OK) err = pcnt_unit_start(m_pcntUnit);
+  if(err != ESP_OK) {
+    ESP_LOGW(TAG, "Pulse counter unavailable on gpio %d (%d), using software edge timestamps", m_pin, err);
+    disablePulseCounter();
+    return false;
+  }
+  gpio_set_pull_mode(m_pin, m_pressedState ? GPIO_PULLDOWN_ONLY : GPIO_PULLUP_ONLY);   // The channel set its own pulls
+  gpio_intr_disable(m_pin);
+  m_pcntCount = 0;
+  m_pulseCounterActive = true;
+  return true;
+#else
+  return false;                                               // No PCNT (ESP32-C3 etc), Debounce_PulseCounter falls back to edge timestamps
+#endif
+}
+
+void InterruptButton::disablePulseCounter(void){
+#if IBTN_HAS_PCNT
+  if(m_pcntUnit != nullptr) {
+    pcnt_unit_stop(m_pcntUnit);
+    pcnt_unit_disable(m_pcntUnit);
+    if(m_pcntChannel != nullptr) pcnt_del_channel(m_pcntChannel);
+    pcnt_del_unit(m_pcntUnit);
+    m_pcntChannel = nullptr;
+    m_pcntUnit = nullptr;
+  }
+#endif
+  m_pulseCounterActive = false;                               // pinInterrupt() hands the edges back to the GPIO ISR
+}
+
+#if IBTN_HAS_PCNT
+bool IRAM_ATTR InterruptButton::pulseWatch(pcnt_unit_handle_t unit, const pcnt_watch_event_data_t* edata, void* ctx){
+  (void)unit; (void)edata;
+  InterruptButton* btn = reinterpret_cast<InterruptButton*>(ctx);
+  useGuard guard(&btn->m_inUse);
+  if(btn->m_retiring) return false;
+  btn->m_pcntCount = 1;                                       // This edge is timestamped, only later ones restart the quiet time
+  edgeCapture(btn);
+  return false;                                               // No task woken here, the servicers are notified by action()
+}
+#endif
+
+void InterruptButton::disableGlitchFilter(void){
+#if IBTN_HAS_GLITCH_FILTER
+  if(m_glitchFilter != nullptr) {
+    if(m_glitchFilterActive) gpio_glitch_filter_disable(m_glitchFilter);
+    gpio_del_glitch_filter(m_glitchFilter);
+    m_glitchFilter = nullptr;
+  }
+#endif
+  m_glitchFilterActive = false;
+}
+
+
+//-- PER-BUTTON MENU LEVEL ------------------------------------------------------------------------------
+void InterruptButton::setButtonMenuLevel(uint8_t level){
+  if(!m_singleMenu && (!m_thisButtonInitialised || level < m_actionRows)) {
+    m_ownMenuLevel = level;                                   // Before begin() it is checked once the number of menus is known
+  } else {
+    ESP_LOGE(TAG, "Button menu level '%d' must be < the button's number of menus (%d)", level, m_singleMenu ? 1 : m_actionRows);
+  }
+}
+
+void InterruptButton::followMenuLevel(void){
+  if(!m_singleMenu) m_ownMenuLevel = -1;
+}
+
+uint8_t InterruptButton::getButtonMenuLevel(void){
+  return menuLevel();
+}
+
+void InterruptButton::setSingleMenu(void){
+  if(m_thisButtonInitialised && m_actionRows > 1) {
+    ESP_LOGW(TAG, "setSingleMenu(): Button already initialised, it is fixed at menu level 0 but keeps its %d rows", m_actionRows);
+  }
+  m_singleMenu = true;
+  m_ownMenuLevel = 0;
+}
+
+
+void InterruptButton::setLane(uint8_t lane){
+  for(int event = 0; event < NumEventTypes; event++) setEventLane(static_cast<events>(event), lane);
+}
+
+void InterruptButton::setEventLane(events event, uint8_t lane){
+  if(lane >= IBTN_ASYNC_LANES || event >= NumEventTypes) {
+    ESP_LOGE(TAG, "setEventLane(): Lane %d or event %d is invalid (IBTN_ASYNC_LANES is %d)", lane, event, IBTN_ASYNC_LANES);
+    return;
+  }
+#if IBTN_ASYNC_LANES > 1
+  m_eventLanes[event] = lane;
+#endif
+}
+
+uint8_t InterruptButton::getEventLane(events event){
+  return (event < NumEventTypes) ? laneOf(event) : 0;
+}
+
+void InterruptButton::setCoalesceRepeats(bool enabled) { m_coalesceRepeats = enabled; }
+bool InterruptButton::getCoalesceRepeats(void)          { return m_coalesceRepeats;   }
+
+void InterruptButton::setFastKeyDown(bool enabled)  { m_fastKeyDown = enabled; }
+bool InterruptButton::getFastKeyDown(void)          { return m_fastKeyDown;   }
+
+
+//-- TIMING INTERVAL GETTERS AND SETTERS -----------------------------------------------------------------
+void      InterruptButton::setLongPressInterval(uint16_t intervalMS)    { m_longKeyPressMS = intervalMS; }
+uint16_t  InterruptButton::getLongPressInterval(void)                   { return m_longKeyPressMS;       }
+void      InterruptButton::setAutoRepeatInterval(uint16_t intervalMS)   { m_autoRepeatMS = intervalMS;   }
+uint16_t  InterruptButton::getAutoRepeatInterval(void)                  { return m_autoRepeatMS;         }
+void      InterruptButton::setDoubleClickInterval(uint16_t intervalMS)  { m_doubleClickMS = intervalMS;  }
+uint16_t  InterruptButton::getDoubleClickInterval(void)                 { return m_doubleClickMS;        }
+void      InterruptButton::setMaxClicks(uint8_t clicks)                 { m_maxClicks = (clicks < 1) ? 1 : clicks; }
+uint8_t   InterruptButton::getMaxClicks(void)                           { return m_maxClicks;            }
+debounceModes InterruptButton::getDebounceMode(void)                    { return m_debounceMode;         }
+ButtonEvent InterruptButton::getLastEvent(void)                         { return m_lastEvent;            }
+
+
+// -- FUNCTIONS RELATED TO EXTERNAL ACTIONS --------------------------------------------------------------
+// -------------------------------------------------------------------------------------------------------
+void InterruptButton::bind(events event, uint8_t menuLevel, func_ptr_t action){
+  if(action == nullptr) {
+    unbind(event, menuLevel);
+  } else if(bindable(event, menuLevel)) {
+#if IBTN_USE_STD_FUNCTION
+    bind(event, menuLevel, &invokeAction, new func_ptr_t(action));  // Owned by the binding, freed by releaseAction()
+#else
+    bind(event, menuLevel, &invokeAction, reinterpret_cast<void*>(action));
+#endif
+  }
+}
+
+void InterruptButton::bind(events event, uint8_t menuLevel, event_cb_t callback, void* ctx){
+  if(!bindable(event, menuLevel)) return;
+
+  boundAction_t previous = actionAt(menuLevel, event);
+  actionAt(menuLevel, event) = { callback, ctx };       // Bind external action to button
+  releaseAction(previous);                              // Only once the new one is in place, see releaseAction()
+  if(!eventEnabled(event)) enableEvent(event);          // Assume if we are binding it, we want it enabled.
+}
+
+bool InterruptButton::bindable(events event, uint8_t menuLevel){
+  if(!m_thisButtonInitialised) initialiseInstance();    // Auto initialisation (typical begin() function)
+
+  if(menuLevel >= m_actionRows) {
+    ESP_LOGE(TAG, "Specified menu level is greater than the number of menus!");
+  } else if(event >= NumEventTypes) {
+    ESP_LOGE(TAG, "Specified event is invalid!");
+  } else if(!compiledIn(event)) {
+    ESP_LOGE(TAG, "Specified event is not built in (IBTN_EVENTS)!");
+  } else {
+    return true;
+  }
+  return false;
+}
+
+void InterruptButton::unbind(events event, uint8_t menuLevel){
+  if(m_numMenus == 0 || eventActions == nullptr){
+    ESP_LOGE(TAG, "You must have bound at least one function prior to unbinding it from a button!");
+  } else if(menuLevel >= m_actionRows) {
+    ESP_LOGE(TAG, "Specified menu level is greater than the number of menus!");
+  } else if(event >= NumEventTypes) {
+    ESP_LOGE(TAG, "Specified event is invalid!");
+  } else {
+    boundAction_t previous = actionAt(menuLevel, event);
+    actionAt(menuLevel, event) = { nullptr, nullptr };
+    releaseAction(previous);
+  }
+  return;
+}
+
+// Called with the slot already rebound or cleared, so no new dispatch can pick the old action up.  A dispatch that
+// looked it up just before copies the std::function under its useGuard, so it is freed once this button has none.
+void InterruptButton::releaseAction(boundAction_t &slot){
+#if IBTN_USE_STD_FUNCTION
+  if(slot.fn == &invokeAction) {
+    waitUnused(m_inUse);
+    delete static_cast<func_ptr_t*>(slot.ctx);
+  }
+#endif
+  slot = { nullptr, nullptr };
+}
+
+void InterruptButton::enableEvent(events event){
+  if(event <= Event_All && event != NumEventTypes && compiledIn(event)) eventMask |= (1UL << (event));    // Set the relevant bit
+}
+void InterruptButton::disableEvent(events event){
+  if(event <= Event_All && event != NumEventTypes) eventMask &= ~(1UL << (event));   // Clear the relevant bit
+}
+
+void InterruptButton::setMenuCount(uint8_t numberOfMenus){           // This can only be set before initialising first button
+  if(!m_classInitialised && numberOfMenus >= 1) m_numMenus = numberOfMenus;
+}
+uint8_t InterruptButton::getMenuCount(void) {
+  return m_numMenus;
+}
+
+void InterruptButton::setMenuLevel(uint8_t level) {
+  if(level < m_numMenus) {
+    m_menuLevel = level;
+  } else {
+    ESP_LOGE(TAG, "Menu level '%d' must be >= 0 AND < number of menus (zero origin): ", level);
+  }
+}
+
+uint8_t InterruptButton::getMenuLevel(){
+  return m_menuLevel;
+}
@@ -1,155 +1,742 @@
-// New in version 2.0.1
-// Moved RTOS task servicer to Core 1
-// Blocked doubleclicks and key presses in the event of an autokeypress event.
-
-#ifndef INTERRUPTBUTTON_H_
-#define INTERRUPTBUTTON_H_
-
-
-#include "driver/gpio.h"
-#include "esp_timer.h"
-#include "freertos/FreeRTOS.h"
-#include "freertos/task.h"
-#include "freertos/queue.h"
-#include <functional>
-
-#define ASYNC_EVENT_QUEUE_DEPTH   5     // This queue is serviced very quickly so can be short
-#define SYNC_EVENT_QUEUE_DEPTH    10    // This queue is limited to mainloop frequency so actions can backup
-#define TARGET_POLLS              10    // Number of times to poll a button to determine it's state
-
-
-typedef std::function<void()> func_ptr_t; // Typedef to faciliate managing pointers to external action functions
-
-enum modes {
-  Mode_Asynchronous,                    // All actions performed via Asynchronous RTOS queue
-  Mode_Hybrid,                          // keyUp and keyDown performed by RTOS queue, remaining actions by Static Synchronous Queue.
-  Mode_Synchronous                      // All actions performed by Synchronous Queue (static class member array, FIFO).
-};
-
-enum events:uint8_t {
-  Event_KeyDown = 0,
-  Event_KeyUp,
-  Event_KeyPress,
-  Event_LongKeyPress,
-  Event_AutoRepeatPress,
-  Event_DoubleClick,
-  NumEventTypes,                        // Not an event, but this value used to size the number of columns in event/action array.
-  Event_All                             // Used to enable or disable all events
-};
-
-
-// -- Interrupt Button and Debouncer ---------------------------------------------------------------------------------------
-// -- ----------------------------------------------------------------------------------------------------------------------
-class InterruptButton {
-  private:
-    enum buttonStates {                 // Enumeration to assist with program flow at state machine for reading button
-      Released,
-      ConfirmingPress,
-      Pressing,
-      Pressed,
-      WaitingForRelease,
-      Releasing
-    };
-
-    // STATIC class members shared by all instances of this object (common across all instances of the class)
-    // ------------------------------------------------------------------------------------------------------
-    static void asyncQueueServicer(void* pvParams);                   // Function used as RTOS task to receive and process action from RTOS message queue.
-    static void readButton(void* arg);                                // function to read button state (must be static to bind to GPIO and timer ISR)
-    static void longPressEvent(void *arg);                            // Callback to excecute a longPress event, called by timer
-    static void autoRepeatPressEvent(void *arg);                      // Callback to excecute a autoRepeatPress event, called by timer
-    static void doubleClickTimeout(void *arg);                        // Callback used to separate double-clicks from regular keyPress's, called by timer
-    static void startTimer(esp_timer_handle_t &timer,                 // Helper func to start timer.
-                           uint32_t duration_US,
-                           void (*callBack)(void* arg),
-                           InterruptButton* btn,
-                           const char *msg);
-    static void killTimer(esp_timer_handle_t &timer);                 // Helper function to kill a timer
-
-    static void action(InterruptButton  *btn,                         // Helper function to simplify calling actions at specified menulevel
-                       events           event,
-                       uint8_t          menuLevel);
-    inline static void action(InterruptButton* btn, events event) { action(btn, event, m_menuLevel); };
-
-    static bool           m_classInitialised;                         // Boolean flag to control class initialisation
-    static bool           m_firstButtonInitialised;                   // Used to block any further changes to m_numMenus
-    static TaskHandle_t   m_asyncQueueServicerHandle;                 // Pointer/handle to the RTOS task that actions the RTOS Queue messages
-    static func_ptr_t     m_asyncEventQueue[];                        // Array used as the Static Synchronous Event Queue
-    static func_ptr_t     m_syncEventQueue[];                         // Array used as the Static Synchronous Event Queue
-
-    static uint8_t        m_numMenus;                                 // Total number of menu sets, can be set by user, but only before initialising first button
-    static uint8_t        m_menuLevel;                                // Current menulevel for all buttons (global in class so common across all buttons)
-    static modes          m_mode;
-    static bool           m_deleteInProgress;                         // Precautionary blocker to prevent asyc calls of object methods while they are being deleted
-
-    // Non-static instance specific member declarations
-    // ------------------------------------------------
-    void                  initialiseInstance(void);                   // Setup interrupts and event-action array
-    bool                  m_thisButtonInitialised = false;            // Allows us to intialise when binding functions (ie detect if already done)
-    gpio_num_t            m_pin;                                      // Button gpio
-    uint8_t               m_pressedState;                             // State of button when it is pressed (LOW or HIGH)
-    gpio_mode_t           m_pinMode;                                  // GPIO mode: IDF's input/output mode
-    volatile buttonStates m_state;                                    // Instance specific state machine variable (intialised when intialising button)
-    volatile bool         m_wtgForDblClick = false;
-    esp_timer_handle_t    m_buttonPollTimer = nullptr;                // Instance specific timer for button debouncing
-    esp_timer_handle_t    m_buttonLPandRepeatTimer = nullptr;         // Instance specific timer for button longPress and autoRepeat timing
-    esp_timer_handle_t    m_buttonDoubleClickTimer = nullptr;         // Instance specific timer for discerning double-clicks from regular keyPresses
-
-    volatile uint8_t      m_doubleClickMenuLevel;                     // Stores current menulevel while differentiating between regular keyPress or a double-click
-    uint16_t              m_pollIntervalUS;                           // Timing variables
-    uint16_t              m_longKeyPressMS;
-    uint16_t              m_autoRepeatMS;
-    uint16_t              m_doubleClickMS;
-
-    volatile bool         m_blockKeyPress;                            // Boolean flag to prevent firing a keypress if a longPress or AutoRepeatPress occurred (outside of polling fuction)
-    volatile uint16_t     m_validPolls = 0;                           // Variables to conduct debouncing algoritm
-    volatile uint16_t     m_totalPolls = 0;
-
-    func_ptr_t**          eventActions = nullptr;                     // Pointer to 2D array, event actions by row, menu levels by column.
-    uint16_t              eventMask = 0b0000010000111;                // Default to keyUp, keyDown, and keyPress enabled, and no blanket disable
-                                                                      // When binding functions, longKeyPress, autoKeyPresses, & double-clicks are automatically enabled.
-
-  public:
-    // Static class members shared by all instances of this object -----------------------
-    static bool     setMode(modes mode);                              // Toggle between Synchronous (Static Queue), Hybrid, or Asynchronous modes (RTOS Queue)
-    static modes    getMode(void);
-    static void     processSyncEvents(void);                          // Process Sync Events, called from main looop
-    static void     setMenuCount(uint8_t numberOfMenus);              // Sets number of menus/pages that each button has (can only be done before intialising first button)
-    static uint8_t  getMenuCount(void);                               // Retrieves total number of menus.
-    static void     setMenuLevel(uint8_t level);                      // Sets menu level across all buttons (ie buttons mean something different each page)
-    static uint8_t  getMenuLevel();                                   // Retrieves menu level
-    static uint32_t m_RTOSservicerStackDepth;                         // Allows the user to set the depth of RTOS servicer function (for bound functions)
-                                                                      // Must be set before initialsing/binding first button or calling setMode().
-
-    // Non-static instance specific member declarations ----------------------------------
-    InterruptButton(uint8_t pin,                                      // Class Constructor, pin to monitor
-                    uint8_t pressedState,                             // State of the pin when pressed (HIGH or LOW)
-                    gpio_mode_t pinMode = GPIO_MODE_INPUT,
-                    uint16_t longKeyPressMS = 750,
-                    uint16_t autoRepeatMS =   250,
-                    uint16_t doubleClickMS =  333,
-                    uint32_t debounceUS =     8000);
-    ~InterruptButton();                                               // Class Destructor
-
-    void            enableEvent(events event);                        // Enable the event passed as argument (updates bitmask)
-    void            disableEvent(events event);                       // Disable the event passed as argument (updates bitmask)
-    bool            eventEnabled(events event);                       // Read bitmask and determine if event is enabled
-    void            setLongPressInterval(uint16_t intervalMS);        // Updates LongPress Interval
-    uint16_t        getLongPressInterval(void);
-    void            setAutoRepeatInterval(uint16_t intervalMS);       // Updates autoRepeat Interval
-    uint16_t        getAutoRepeatInterval(void);
-    void            setDoubleClickInterval(uint16_t intervalMS);      // Updates autoRepeat Interval
-    uint16_t        getDoubleClickInterval(void);
-
-
-    // Routines to manage interface with external action functions associated with each event ---
-    void            bind(events     event,                                  // Used to bind an action to an event at a given menulevel
-                         uint8_t    menuLevel,
-                         func_ptr_t action);
-    inline void     bind(events event, func_ptr_t action) { bind(event, m_menuLevel, action); } // Above function defaulting to current menulevel
-
-    void            unbind(events   event,                                  // Used to unbind an action to an event at a given menulevel
-                           uint8_t  menuLevel);
-    inline void     unbind(events event) { unbind(event, m_menuLevel); };   // Above function defaulting to current menulevel
-};
-
-#endif // INTERRUPTBUTTON_H_
+// New in version 2.0.1
+// Moved RTOS task servicer to Core 1
+// Blocked doubleclicks and key presses in the event of an autokeypress event.
+
+#ifndef INTERRUPTBUTTON_H_
+#define INTERRUPTBUTTON_H_
+
+
+#include "driver/gpio.h"
+#include "esp_timer.h"
+#include "soc/soc_caps.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/queue.h"
+#include "InterruptButtonRing.h"
+#include <atomic>
+#include <type_traits>
+
+#ifndef ASYNC_EVENT_QUEUE_DEPTH
+#define ASYNC_EVENT_QUEUE_DEPTH   8     // This queue is serviced very quickly so can be short (must be a power of two)
+#endif
+#ifndef SYNC_EVENT_QUEUE_DEPTH
+#define SYNC_EVENT_QUEUE_DEPTH    16    // This queue is limited to mainloop frequency so actions can backup (must be a power of two)
+#endif
+#ifndef EVENT_TASK_PRIORITY
+#define EVENT_TASK_PRIORITY       2     // One level higher than arduino's loop() which is priority level 1 (lane 0, further lanes one higher each)
+#endif
+#ifndef EVENT_TASK_STACK
+#define EVENT_TASK_STACK          2048  // Default stack size of the queue servicers (m_RTOSservicerStackDepth)
+#endif
+#ifndef EVENT_TASK_CORE
+#define EVENT_TASK_CORE           1     // Same core as setup() and loop()
+#endif
+#ifndef IBTN_ASYNC_LANES
+#define IBTN_ASYNC_LANES          1     // Asynchronous queues, each with its own RTOS servicer task (lane 0 is the default for every event, max 4)
+#endif
+#ifndef IBTN_MAX_WORKERS
+#define IBTN_MAX_WORKERS          1     // Servicer tasks a lane can share its queue between (setLaneWorkers()), max 8
+#endif
+#ifndef TARGET_POLLS
+#define TARGET_POLLS              10    // Number of times to poll a button to determine it's state
+#endif
+#ifndef IBTN_COUNTER_PLANES
+#define IBTN_COUNTER_PLANES       4     // Debounce_Batched: bits per vertical counter, must be able to count to TARGET_POLLS
+#endif
+#define IBTN_GPIO_BANKS           ((SOC_GPIO_PIN_COUNT + 31) / 32)  // 32 bit GPIO input registers
+
+#if __has_include("driver/gpio_filter.h") && (SOC_GPIO_SUPPORT_PIN_GLITCH_FILTER || SOC_GPIO_FLEX_GLITCH_FILTER_NUM > 0)
+#include "driver/gpio_filter.h"
+#define IBTN_HAS_GLITCH_FILTER    1     // Target (and IDF version) provides a hardware GPIO glitch filter, used by Debounce_Hardware
+#else
+#define IBTN_HAS_GLITCH_FILTER    0
+#endif
+
+#if __has_include("driver/pulse_cnt.h") && SOC_PCNT_SUPPORTED
+#include "driver/pulse_cnt.h"
+#define IBTN_HAS_PCNT             1     // Target (and IDF version) has the pulse counter driver, used by Debounce_PulseCounter
+#else
+#define IBTN_HAS_PCNT             0
+#endif
+
+#if defined(CONFIG_ESP_TIMER_SUPPORTS_ISR_DISPATCH_METHOD) && CONFIG_ESP_TIMER_SUPPORTS_ISR_DISPATCH_METHOD
+#define IBTN_HAS_ISR_TIMERS       1     // esp_timer can run callbacks from its interrupt (ESP_TIMER_ISR), used by setTimerDispatch()
+#else
+#define IBTN_HAS_ISR_TIMERS       0
+#endif
+
+#ifndef IBTN_GLITCH_FILTER_NS
+#define IBTN_GLITCH_FILTER_NS     1000  // Pulses shorter than this are removed by the flex glitch filter (where available)
+#endif
+
+#ifndef IBTN_USE_STD_FUNCTION
+#define IBTN_USE_STD_FUNCTION     0     // Set to 1 to bind std::function (ie capturing lambdas), otherwise <functional> isn't used at all
+#endif
+
+#ifndef IBTN_MAX_CHORDS
+#define IBTN_MAX_CHORDS           8     // Size of the chord table (chords may use up to 32 different buttons between them)
+#endif
+
+#ifndef IBTN_MAX_WAKE_BUTTONS
+#define IBTN_MAX_WAKE_BUTTONS     8     // Buttons that can wake the chip from light or deep sleep (setWakeup())
+#endif
+
+#ifndef IBTN_HISTORY_DEPTH
+#define IBTN_HISTORY_DEPTH        0     // Entries kept in each button's history (getHistory(), gestures), a power of two, 0 leaves it out
+#endif
+
+#ifndef IBTN_MAX_GESTURES
+#define IBTN_MAX_GESTURES         8     // Size of the gesture table (see addGesture(), needs IBTN_HISTORY_DEPTH)
+#endif
+
+#ifndef IBTN_EVENTS
+#define IBTN_EVENTS               0xFFFF  // Event types built in, bit n for events value n.  Handling for the others is compiled out
+#endif                                    // and they can't be enabled or bound, ie ((1 << Event_KeyDown) | (1 << Event_KeyUp) | ...)
+
+#ifndef IBTN_TRACE
+#define IBTN_TRACE                0     // 1 records to SEGGER SystemView, 2 calls the application's ibtnTrace() (ie for esp_app_trace), 0 leaves it out
+#endif
+
+#ifndef IBTN_STATS
+#define IBTN_STATS                0     // Set to 1 to collect the counters returned by getStats(), otherwise none of it is compiled in
+#endif
+
+#if IBTN_USE_STD_FUNCTION
+#include <functional>
+typedef std::function<void()> func_ptr_t; // Typedef to faciliate managing pointers to external action functions
+#else
+typedef void (*func_ptr_t)();             // Plain function pointer (also accepts lambdas that don't capture)
+#endif
+
+enum modes {
+  Mode_Asynchronous,                    // All actions performed via Asynchronous RTOS queue
+  Mode_Hybrid,                          // keyUp and keyDown performed by RTOS queue, remaining actions by Static Synchronous Queue.
+  Mode_Synchronous                      // All actions performed by Synchronous Queue (static class member array, FIFO).
+};
+
+class InterruptButton;
+class InterruptButtonMatrix;
+
+enum debounceModes:uint8_t {
+  Debounce_Polling,                     // Poll the pin TARGET_POLLS times across the debounce time after each edge (default)
+  Debounce_EdgeTimestamp,               // Timestamp every edge, decide once the line has been quiet for the debounce time
+  Debounce_Hardware,                    // Hardware glitch filter plus Debounce_EdgeTimestamp, or Debounce_Polling if the target has no filter
+  Debounce_Batched,                     // Polled together with every Debounce_Batched button on the same GPIO bank, one register read per tick
+  Debounce_PulseCounter                 // Edges counted (and glitch filtered) by a PCNT unit, one interrupt per settled change however noisy the line
+};
+
+enum events:uint8_t {
+  Event_KeyDown = 0,
+  Event_KeyUp,
+  Event_KeyPress,
+  Event_LongKeyPress,
+  Event_AutoRepeatPress,
+  Event_DoubleClick,
+  Event_Chord,                          // Raised on the first button of a chord (see addChord()), evt.data is the chord's index
+  Event_Rotate,                         // Raised by an InterruptEncoder, evt.data is the detents turned (signed) since the last one was actioned
+  Event_Gesture,                        // Raised when a button's latest presses match one of its gestures (see addGesture()), evt.data is its index
+  Event_MultiClick,                     // Three or more clicks in a row (up to setMaxClicks()), or two if no doubleClick is bound, evt.data is the number of clicks
+  NumEventTypes,                        // Not an event, but this value used to size the number of columns in event/action array.
+  Event_All                             // Used to enable or disable all events
+};
+
+struct ButtonEvent {                    // Compact record placed on the event queues, the bound action is looked up when it is dispatched
+  InterruptButton*  button;             // Button that raised the event
+  events            event;
+  uint8_t           menuLevel;          // Menu level at the time the event occurred
+  int16_t           data;               // Event specific: Event_Chord the chord's index, Event_AutoRepeatPress the number of repeats,
+                                        // Event_Rotate the detents turned, Event_DoubleClick/MultiClick the clicks, otherwise 0
+  uint32_t          timestampUS;        // esp_timer_get_time() of the input edge (or timer expiry) that gave rise to the event
+};
+
+#if IBTN_TRACE
+enum tracePoints:uint8_t {              // Trace records, each with the button's id (its gpio, or its address if it has none) and a value
+  Trace_State,                          // Entered debounce state 'value' (0 Released, 1 ConfirmingPress, 2 Pressing, 3 Pressed, 4 WaitingForRelease, 5 Releasing)
+  Trace_Enqueue,                        // Event 'value' queued
+  Trace_Drop,                           // Event 'value' lost, its queue was full
+  Trace_DispatchBegin,                  // Action for event 'value' starting
+  Trace_DispatchEnd,                    // and returned
+  NumTracePoints
+};
+#if IBTN_TRACE == 2
+void ibtnTrace(uint8_t point, uint32_t buttonId, uint32_t value);  // Supplied by the application, it is called from ISRs so must be IRAM_ATTR
+#endif
+#endif
+
+#if IBTN_HISTORY_DEPTH
+enum historyKinds:uint8_t {
+  History_Press,                        // Debounced press, timestampUS is its first edge
+  History_Release,                      // Debounced release, likewise
+  History_Event                         // Event queued for the button
+};
+
+struct ButtonHistoryEntry {             // One entry of a button's history, recorded (without allocating) as it happens
+  uint32_t          timestampUS;
+  historyKinds      kind;
+  events            event;              // History_Event: the event queued, and the menu level it was raised at
+  uint8_t           menuLevel;
+};
+#endif
+
+#if IBTN_STATS
+struct InterruptButtonQueueStats {      // Counters for one of the event queues
+  uint32_t          enqueued;
+  uint32_t          dropped;            // Events lost because the queue (or a pool worker's hand over queue) was full
+  uint16_t          highWater;          // Most entries waiting at once (when this button, or any button for the class totals, queued)
+};
+
+struct InterruptButtonStats {           // Returned by getStats() for all buttons and getButtonStats() for a single button
+  uint32_t          edges;              // Input edges taken by the GPIO ISR
+  uint32_t          falseAlarms;        // Debounces that ended with the button back in its previous state
+  uint32_t          dispatched;         // Events whose bound action was run
+  uint32_t          latencyMinUS;       // From the event's timestampUS (edge or timer expiry) to the start of its action
+  uint32_t          latencyMaxUS;
+  uint64_t          latencySumUS;
+  InterruptButtonQueueStats asyncQueue;
+  InterruptButtonQueueStats syncQueue;
+  inline uint32_t   latencyAvgUS(void) const { return dispatched ? static_cast<uint32_t>(latencySumUS / dispatched) : 0; }
+};
+#endif
+
+typedef void (*event_cb_t)(void* ctx, const ButtonEvent& evt);  // Callback with user context, called directly (no type erasure)
+
+
+// -- Interrupt Button and Debouncer ---------------------------------------------------------------------------------------
+// -- ----------------------------------------------------------------------------------------------------------------------
+class InterruptButton {
+  friend class InterruptButtonMatrix;   // Matrix keys are InterruptButtons, debounced from the matrix scan rather than their own pin
+  friend class InterruptEncoder;        // An encoder raises its Event_Rotate through an InterruptButton with no pin
+
+  protected:
+    struct boundAction_t {              // What is stored for each event, every binding method reduces to a callback and its context
+      event_cb_t          fn;
+      void*               ctx;
+    };
+    void                  useActionStorage(boundAction_t* storage,    // Supply the event-action table (menus * NumEventTypes) instead of allocating it
+                                           uint8_t menus);
+
+  private:
+    enum buttonStates {                 // Enumeration to assist with program flow at state machine for reading button
+      Released,
+      ConfirmingPress,
+      Pressing,
+      Pressed,
+      WaitingForRelease,
+      Releasing
+    };
+
+    enum buttonTimers:uint8_t {         // Each button has one of each timer, either its own esp_timer or a deadline on the shared scheduler
+      Timer_Poll,
+      Timer_LPandRepeat,
+      Timer_DoubleClick,
+      Timer_Classify,                   // Task context half of a debounce timed from the timer ISR (see setTimerDispatch())
+      NumTimers
+    };
+
+    struct deadline_t {                 // Node in the shared scheduler's list of pending deadlines (sorted by due time)
+      uint64_t            dueUS;
+      deadline_t*         next;
+      esp_timer_cb_t      callback;     // Run by the scheduler's esp_timer task when due, ie a button timer handler
+      void*               arg;
+      bool                armed;
+      std::atomic<uint32_t>* inUse;     // Use count of its owner, held while the callback runs (nullptr if never deleted)
+    };
+
+    struct bank_t {                     // Debounce_Batched: the buttons on one GPIO bank, debounced together one bit per pin
+      uint32_t            members;      // Pins of batched buttons
+      uint32_t            active;       // Pins being debounced (their interrupt is off until decided)
+      uint32_t            stable;       // Debounced level of each pin (as read, not pressed/released)
+      uint32_t            changeCount[IBTN_COUNTER_PLANES]; // Vertical counters: consecutive samples away from the stable level
+      uint32_t            quietCount[IBTN_COUNTER_PLANES];  // and consecutive samples at it (a false alarm once TARGET_POLLS)
+      uint16_t            intervalUS;   // Sample period, the shortest of the members'
+      InterruptButton*    buttons[32];
+      deadline_t          deadline;     // The bank's tick on the shared scheduler
+    };
+
+    struct chord_t {                    // Registered chord, matched against m_pressedMask when one of its buttons goes down
+      uint32_t            mask;         // Chord bits of its buttons
+      InterruptButton*    owner;        // First button given, Event_Chord is actioned on it
+    };
+
+#if IBTN_HISTORY_DEPTH
+    struct gesture_t {                  // Registered gesture, matched against the owner's history when an Event_Gesture is dispatched
+      InterruptButton*    owner;
+      uint8_t             steps;        // Presses in the gesture
+      uint8_t             longSteps;    // Bit n set if the nth press from the end is held past the longPress time
+    };
+#endif
+
+    struct useGuard {                   // Held by every ISR, timer and dispatch on the object it uses, see ~InterruptButton()
+      explicit inline useGuard(std::atomic<uint32_t>* inUse, bool taken = false) : count(inUse) {   // taken: already
+        if(count != nullptr && !taken) count->fetch_add(1, std::memory_order_seq_cst);              // counted (claim())
+      }
+      inline ~useGuard(void) { if(count != nullptr) count->fetch_sub(1, std::memory_order_release); }
+      useGuard(const useGuard&) = delete;
+      useGuard& operator=(const useGuard&) = delete;
+      std::atomic<uint32_t>* count;
+    };
+
+    // STATIC class members shared by all instances of this object (common across all instances of the class)
+    // ------------------------------------------------------------------------------------------------------
+    struct laneTask_t {                 // RTOS servicer settings for one lane, unset lanes use the defaults (setLaneTask())
+      UBaseType_t         priority;
+      BaseType_t          core;
+      bool                set;
+      uint8_t             workers;      // Tasks sharing the lane's queue, 0 or 1 for a single servicer
+      BaseType_t          workerCores[IBTN_MAX_WORKERS];
+      bool                workerCoresSet;
+    };
+
+    struct worker_t {                   // One of a lane's servicer tasks
+      TaskHandle_t        task;
+      uint8_t             lane;
+#if IBTN_MAX_WORKERS > 1
+      InterruptButton*    current;      // Button whose action it is running, events for it taken meanwhile are handed over here
+      InterruptButtonRing<ButtonEvent, ASYNC_EVENT_QUEUE_DEPTH> handoff;
+#endif
+    };
+
+    static void asyncQueueServicer(void* pvParams);                   // Function used as RTOS task to receive and process action from RTOS message queue (pvParams is its lane).
+    static void notifyServicer(uint8_t lane);                         // Wakes the lane's RTOS task when an action is added to its asynchronous queue
+#if IBTN_MAX_WORKERS > 1
+    static bool takePooled(worker_t &worker, ButtonEvent &evt);       // Worker pool: next event whose button no other worker is busy with
+    static void finishPooled(worker_t &worker);                       // Worker pool: run the events handed over meanwhile, then release the button
+#endif
+    static inline uint8_t laneWorkers(uint8_t lane) { return m_laneTasks[lane].workers > 1 ? m_laneTasks[lane].workers : 1; }
+    static void readButton(void* arg);                                // function to read button state (must be static to bind to GPIO and timer ISR)
+    static void edgeCapture(void* arg);                               // GPIO ISR used by Debounce_EdgeTimestamp, only timestamps the edge
+    static void batchedEdge(void* arg);                               // GPIO ISR used by Debounce_Batched, hands the pin over to its bank's tick
+    static void bankTick(void* arg);                                  // Debounce_Batched: sample a whole bank and step its vertical counters
+    static uint32_t countSamples(uint32_t (&planes)[IBTN_COUNTER_PLANES], // Vertical counter step, returns the bits that reached TARGET_POLLS
+                                 uint32_t bits);
+    static bool lineSettled(InterruptButton* btn, uint32_t &edgeUS);  // Debounce_EdgeTimestamp: has the line been quiet for the debounce time
+    static void fastKeyDown(InterruptButton* btn);                    // Sends keyDown on the first edge if enabled for the button
+    static void cancelFastKeyDown(InterruptButton* btn);              // Follows an early keyDown with a keyUp if the press was a false alarm
+    static void longPressEvent(void *arg);                            // Callback to excecute a longPress event, called by timer
+    static void autoRepeatPressEvent(void *arg);                      // Callback to excecute a autoRepeatPress event, called by timer
+    static void doubleClickTimeout(void *arg);                        // Callback used to separate double-clicks from regular keyPress's, called by timer
+    static void clicksDone(InterruptButton* btn);                     // Raises the keyPress, doubleClick or multiClick for the clicks counted
+    static void longPressAndRepeatTimeout(void *arg);                 // Callback of the shared longPress/autoRepeat timer, hands off to one of the two above
+    static bool createTimer(esp_timer_handle_t &timer,                // Helper func to create a timer (once per button, when initialising)
+                            void (*callBack)(void* arg),
+                            void* arg,
+                            const char *name,
+                            esp_timer_dispatch_t dispatch = ESP_TIMER_TASK);
+    static void startTimer(InterruptButton* btn,                      // Helper func to (re)start one of a button's timers.
+                           buttonTimers timer,
+                           uint32_t duration_US);
+    static void killTimer(InterruptButton* btn, buttonTimers timer);  // Helper function to stop a timer (it remains available for reuse)
+    static void deleteTimer(esp_timer_handle_t &timer);               // Helper function to release a timer (only when deleting the button)
+    static inline esp_timer_cb_t timerCallback(buttonTimers timer) {  // Handler associated with each of the button timers
+      return (timer == Timer_Poll) ? &readButton : (timer == Timer_LPandRepeat) ? &longPressAndRepeatTimeout :
+             (timer == Timer_DoubleClick) ? &doubleClickTimeout : &classifyTimeout;
+    }
+    static bool deferClassify(InterruptButton* btn,                   // Timer ISR debounce: leave a confirmed press or release to Timer_Classify
+                              buttonStates state);
+    static void classifyTimeout(void *arg);                           // Callback of Timer_Classify, sends the events in task context
+    static void scheduleDeadline(deadline_t &node, uint64_t dueUS);  // Shared scheduler: (re)insert a deadline in due order
+    static void cancelDeadline(deadline_t &node);                     // Shared scheduler: remove a deadline if pending
+    static void unlinkDeadline(deadline_t &node);
+    static void armScheduler(void);                                   // Shared scheduler: set the hardware timer for the earliest deadline
+    static void schedulerTimeout(void *arg);                          // Shared scheduler: hardware timer callback, runs all due deadlines
+
+    static void action(InterruptButton  *btn,                         // Helper function to simplify calling actions at specified menulevel
+                       events           event,
+                       uint8_t          menuLevel,
+                       uint32_t         timestampUS,
+                       int16_t          data = 0);
+    inline static void action(InterruptButton* btn, events event) { action(btn, event, btn->menuLevel(), btn->m_edgeUS); };
+    static void chordPressed(InterruptButton* btn);                   // Button confirmed down: add it to m_pressedMask and look for a chord
+    static void chordReleased(InterruptButton* btn);
+    static bool coalesce(InterruptButton* btn, int16_t count);        // Adds to the count of the entry waiting, true if it needs a queue entry of its own
+    static void uncoalesce(InterruptButton* btn);                     // The entry coalesce() asked for couldn't be queued
+    static inline bool coalescedEntry(const ButtonEvent &evt) {       // Known by its event, not a value taken from the data range: every rotation
+      return evt.event == Event_Rotate || (evt.event == Event_AutoRepeatPress && evt.data == 0);   // and no plain autoRepeat (whose data is 1)
+    }
+    static bool replayWake(InterruptButton* btn, bool deepSleep);     // Feeds the press that woke the chip into the state machine
+#if IBTN_HISTORY_DEPTH
+    static void record(InterruptButton* btn,                          // Adds an entry to the button's history, overwriting the oldest
+                       historyKinds kind,
+                       uint32_t timestampUS,
+                       events event = NumEventTypes,
+                       uint8_t menuLevel = 0);
+    static int8_t matchGesture(InterruptButton* btn, uint32_t releaseUS); // The gesture ended by this release, or -1 (servicer / main loop)
+#endif
+    template<typename F>
+    static bool dispatchNext(F take, bool* ran = nullptr);            // Runs the action for the next event take() gives, false if there was none
+                                                                      // (ran is cleared if it was skipped, ie its button was deleted)
+    static bool prepareAction(ButtonEvent &evt, boundAction_t &bound); // Looks up the action for a queued event, false if there is nothing to run
+    static bool validCore(BaseType_t core);                           // A core a servicer can be pinned to, or tskNO_AFFINITY
+    static void waitUnused(const std::atomic<uint32_t> &inUse);       // Until no callback holds a useGuard on that one object (a moment is enough)
+    static void claim(ButtonEvent &evt);                              // Counts a use of the entry's button, under the lock of the queue it is taken from
+    static inline std::atomic<uint32_t>* useCount(InterruptButton* btn) { return (btn != nullptr) ? &btn->m_inUse : nullptr; }
+    static void invokeAction(void* ctx, const ButtonEvent &evt);      // Trampoline used when binding a func_ptr_t
+#if IBTN_STATS
+    static void countStat(InterruptButton* btn,                       // Stats: bump one of the counters, for the button and the class
+                          uint32_t InterruptButtonStats::*counter);
+    static void countQueued(InterruptButton* btn,                     // Stats: record an attempt to add an event to a queue
+                            InterruptButtonQueueStats InterruptButtonStats::*queue,
+                            bool queued,
+                            uint16_t waiting);
+    static void countDispatch(InterruptButton* btn, uint32_t latencyUS); // Stats: record an event being actioned
+    static void addLatency(InterruptButtonStats &stats, uint32_t latencyUS);
+#endif
+#if __cplusplus >= 201703L
+    template<auto Fn>
+    static void invokeStatic(void* ctx, const ButtonEvent &evt) {     // Trampoline used by bind<Fn>(), the call to Fn is resolved at compile time
+      (void)ctx;
+      if constexpr (std::is_invocable_v<decltype(Fn), const ButtonEvent&>) Fn(evt); else Fn();
+    }
+#endif
+
+    static bool           initialiseClass(void);                      // Done once, when the first button (or matrix) is initialised
+    static bool           startScheduler(void);                       // Creates the shared scheduler's timer when it is first needed
+    static bool           m_classInitialised;                         // Boolean flag to control class initialisation
+    static bool           m_firstButtonInitialised;                   // Used to block any further changes to m_numMenus
+    static worker_t       m_workers[IBTN_ASYNC_LANES][IBTN_MAX_WORKERS]; // The RTOS tasks that action each lane's RTOS Queue messages
+#if IBTN_MAX_WORKERS > 1
+    static volatile uint8_t m_idleWorkers[IBTN_ASYNC_LANES];          // Worker pool: workers waiting for a notification, by lane
+    static portMUX_TYPE   m_poolMux;
+#endif
+    static InterruptButtonRing<ButtonEvent, ASYNC_EVENT_QUEUE_DEPTH> m_asyncEventQueue[IBTN_ASYNC_LANES]; // Rings used as the Asynchronous Event Queues (RTOS servicers)
+    static laneTask_t     m_laneTasks[IBTN_ASYNC_LANES];
+    static InterruptButtonRing<ButtonEvent, SYNC_EVENT_QUEUE_DEPTH>  m_syncEventQueue;  // Ring used as the Static Synchronous Event Queue
+
+    static uint8_t        m_numMenus;                                 // Total number of menu sets, can be set by user, but only before initialising first button
+    static uint8_t        m_menuLevel;                                // Current menulevel for all buttons (global in class so common across all buttons)
+    static modes          m_mode;
+    static bool           m_sharedTimers;                             // Buttons initialised while set use the shared scheduler instead of their own timers
+    static esp_timer_dispatch_t m_timerDispatch;                      // How the debounce timers of buttons initialised while set are called back
+    static esp_timer_handle_t m_schedulerTimer;                       // The one hardware timer driving the shared scheduler
+    static deadline_t*    m_schedulerHead;                            // Earliest pending deadline
+    static portMUX_TYPE   m_schedulerMux;
+    static bank_t         m_banks[IBTN_GPIO_BANKS];                   // Debounce_Batched buttons, by GPIO bank
+    static portMUX_TYPE   m_bankMux;
+    static chord_t        m_chords[IBTN_MAX_CHORDS];
+    static uint8_t        m_numChords;
+    static InterruptButton* m_chordButtons[32];                       // Button holding each chord bit
+    static volatile uint32_t m_pressedMask;                           // Chord bits of the buttons currently (debounced) down
+    static portMUX_TYPE   m_chordMux;
+    static portMUX_TYPE   m_repeatMux;                                // Guards each button's coalesced repeat (or rotation) count
+    static InterruptButton* m_firstButton;                            // Every initialised button, linked through m_nextButton
+    static portMUX_TYPE   m_buttonsMux;
+    static InterruptButton* m_wakeButtons[IBTN_MAX_WAKE_BUTTONS];     // Buttons set up as wakeup sources by prepareForSleep()
+    static uint8_t        m_numWakeButtons;
+    static bool           m_lightSleepArmed;                          // Their pins are light sleep wakeup sources until resumeFromSleep()
+    static bool           m_wakeReplayed;                             // The wake cause has been dealt with, until the next prepareForSleep()
+#if IBTN_HISTORY_DEPTH
+    static gesture_t      m_gestures[IBTN_MAX_GESTURES];
+    static uint8_t        m_numGestures;
+    static portMUX_TYPE   m_historyMux;                               // Guards each button's history and the gesture table
+#endif
+#if IBTN_STATS
+    static InterruptButtonStats m_classStats;                         // Totals for all buttons, including any since deleted
+    static portMUX_TYPE   m_statsMux;
+#endif
+
+    // Non-static instance specific member declarations
+    // ------------------------------------------------
+    void                  initialiseInstance(void);                   // Setup interrupts and event-action array
+    void                  prepareInstance(void);                      // First part of the above: the event-action array and timers
+    void                  attachPin(void);                            // Last part: filters, the pin's ISR and its starting state (once its gpio is configured)
+    gpio_config_t         pinConfig(uint64_t pinMask);                // gpio_config() settings for this button's pin, applied to every pin in pinMask
+    bool                  bindable(events event, uint8_t menuLevel);  // Initialises if required and validates a binding request
+    bool                  enableGlitchFilter(void);                   // Debounce_Hardware: returns true if the hardware filter is now active
+    void                  disableGlitchFilter(void);
+    bool                  enablePulseCounter(void);                   // Debounce_PulseCounter: returns true if a PCNT unit now counts the pin's edges
+    void                  disablePulseCounter(void);
+#if IBTN_HAS_PCNT
+    static bool           pulseWatch(pcnt_unit_handle_t unit,         // PCNT watch point ISR: the first edge since the line last settled
+                                     const pcnt_watch_event_data_t* edata,
+                                     void* ctx);
+#endif
+    void                  joinBank(void);                             // Debounce_Batched: add the pin to its bank's sampling
+    void                  leaveBank(void);
+    void                  leaveChords(void);                          // Removes the button's chords when it is deleted
+    void                  leaveWake(void);                            // Removes the button from the wakeup sources
+    void                  leaveButtons(void);                         // Removes the button from the initialised buttons
+    void                  leaveGestures(void);                        // Removes the button's gestures when it is deleted
+    inline bool           edgeTimestamped(void) { return m_debounceMode == Debounce_EdgeTimestamp || m_debounceMode == Debounce_PulseCounter ||
+                                                         (m_debounceMode == Debounce_Hardware && m_glitchFilterActive); }
+    inline bool           matrixKey(void) { return m_levelWord != nullptr; }
+    inline bool           ownPin(void) { return !matrixKey() && !m_virtualSource; }  // Configured, interrupted and reset by this button
+    inline int            pinLevel(void) { return matrixKey() ? ((*m_levelWord & m_levelMask) ? 1 : 0) :
+                                                  m_virtualSource ? !m_pressedState : gpio_get_level(m_pin); }
+    inline uint32_t       settleLookUS(void) const { return m_pulseCounterActive ? m_debounceUS / 4 + 1 : m_debounceUS; } // A count only says an edge came since the last look
+    inline void           pinInterrupt(bool enable) { if(ownPin() && !m_pulseCounterActive) { if(enable) gpio_intr_enable(m_pin); else gpio_intr_disable(m_pin); } }
+    inline gpio_isr_t     isrHandler(void) { return edgeTimestamped() ? &edgeCapture : (m_debounceMode == Debounce_Batched) ? &batchedEdge : &readButton; }
+    void                  releaseAction(boundAction_t &slot);         // Frees anything owned by a binding and clears it
+    inline boundAction_t& actionAt(uint8_t menuLevel, events event) { return eventActions[menuLevel * NumEventTypes + event]; }
+    inline bool           actionBound(uint8_t menuLevel, events event) { return menuLevel < m_actionRows && actionAt(menuLevel, event).fn != nullptr; }
+#if IBTN_ASYNC_LANES > 1
+    inline uint8_t        laneOf(events event) { return m_eventLanes[event]; }
+#else
+    inline uint8_t        laneOf(events event) { (void)event; return 0; }
+#endif
+    static constexpr bool countsClicks(void) {                       // Clicks are counted at all (Event_DoubleClick or Event_MultiClick built in)
+      return compiledIn(Event_DoubleClick) || compiledIn(Event_MultiClick);
+    }
+    inline uint8_t        clickLimit(uint8_t menuLevel) {             // Most clicks worth waiting for at this menu level, 1 if only keyPress is bound
+      if(!countsClicks() || !eventEnabled(Event_All)) return 1;
+      if(m_maxClicks > 2 && eventEnabled(Event_MultiClick) && actionBound(menuLevel, Event_MultiClick)) return m_maxClicks;
+      return (m_maxClicks > 1 && eventEnabled(Event_DoubleClick) && actionBound(menuLevel, Event_DoubleClick)) ? 2 : 1;
+    }
+    inline uint8_t        menuLevel(void) { return (m_ownMenuLevel < 0) ? m_menuLevel : static_cast<uint8_t>(m_ownMenuLevel); }
+    static inline uint32_t traceId(const InterruptButton* btn) {      // Button's id in trace records, its gpio or if it has none (ie a matrix key) its address
+      return (btn->m_pin >= 0) ? static_cast<uint32_t>(btn->m_pin) : static_cast<uint32_t>(reinterpret_cast<uintptr_t>(btn));
+    }
+    bool                  m_thisButtonInitialised = false;            // Allows us to intialise when binding functions (ie detect if already done)
+    volatile bool         m_retiring = false;                         // Being deleted, callbacks that reach it return straight away
+    std::atomic<uint32_t> m_inUse { 0 };                              // Callbacks using this button right now (useGuard), the destructor waits for none
+    gpio_num_t            m_pin;                                      // Button gpio
+    uint8_t               m_pressedState;                             // State of button when it is pressed (LOW or HIGH)
+    gpio_mode_t           m_pinMode;                                  // GPIO mode: IDF's input/output mode
+    volatile buttonStates m_state;                                    // Instance specific state machine variable (intialised when intialising button)
+    volatile uint8_t      m_clickCount = 0;                           // Clicks so far, while waiting to see if another begins within the double-click time
+    uint8_t               m_maxClicks = 2;                            // Count at which the clicks are actioned without waiting (setMaxClicks())
+    volatile uint32_t     m_clickUS = 0;                              // Release edge of the latest click
+    volatile bool         m_keyDownSent = false;                      // keyDown already sent on the first edge (fast keyDown)
+    bool                  m_fastKeyDown = false;
+    volatile bool         m_autoRepeating = false;                    // Selects whether the LPandRepeat timer is timing a longPress or an autoRepeat
+    bool                  m_coalesceRepeats = false;                  // Fold autoRepeats into the one already queued (setCoalesceRepeats())
+    volatile bool         m_coalescedQueued = false;                  // A coalesced entry (autoRepeat or rotation) is waiting on a queue
+    volatile int16_t      m_pendingCount = 0;                         // Repeats or detents it stands for so far
+    esp_timer_handle_t    m_timers[NumTimers] = {};                   // Instance specific timers for debouncing, longPress/autoRepeat and double-clicks
+    deadline_t            m_deadlines[NumTimers] = {};                // Or the same timers as deadlines on the shared scheduler
+    bool                  m_usesScheduler = false;
+    bool                  m_isrDebounce = false;                      // Its debounce timer runs from the timer ISR, events are sent from Timer_Classify
+
+    volatile uint32_t     m_edgeUS = 0;                               // Time of the edge that began the current press or release
+    volatile uint32_t     m_lastEdgeUS = 0;                           // Time of the most recent edge (Debounce_EdgeTimestamp)
+    debounceModes         m_debounceMode = Debounce_Polling;
+    bool                  m_glitchFilterActive = false;
+#if IBTN_HAS_GLITCH_FILTER
+    gpio_glitch_filter_handle_t m_glitchFilter = nullptr;
+#endif
+    bool                  m_pulseCounterActive = false;               // Debounce_PulseCounter: edges go to the PCNT, the GPIO interrupt stays off
+#if IBTN_HAS_PCNT
+    pcnt_unit_handle_t    m_pcntUnit = nullptr;
+    pcnt_channel_handle_t m_pcntChannel = nullptr;
+    volatile int          m_pcntCount = 0;                            // Count when last sampled, a change means the line is still bouncing
+#endif
+    ButtonEvent           m_lastEvent = {};                           // Event record most recently actioned for this button
+    uint32_t              m_chordBit = 0;                             // Bit in m_pressedMask, given when the button is first used in a chord
+    bool                  m_wakeSource = false;                       // Listed in m_wakeButtons (setWakeup())
+    InterruptButton*      m_nextButton = nullptr;                     // In the list of initialised buttons (m_firstButton)
+#if IBTN_HISTORY_DEPTH
+    ButtonHistoryEntry    m_history[IBTN_HISTORY_DEPTH] = {};         // Ring of the latest presses, releases and events
+    uint16_t              m_historyHead = 0;                          // Entries ever recorded (free running, masking gives the slot)
+    uint8_t               m_gestureCount = 0;                         // Gestures in the table for this button, an Event_Gesture is queued on release if any
+#endif
+    const volatile uint32_t* m_levelWord = nullptr;                   // Matrix key: pressed when this bit of the scanned key map is set (no pin of its own)
+    uint32_t              m_levelMask = 0;
+    bool                  m_virtualSource = false;                    // Raises the events of something else (an encoder), has no pin, timers or debounce
+#if IBTN_STATS
+    InterruptButtonStats  m_stats = {};
+#endif
+    volatile uint8_t      m_clickMenuLevel = 0;                       // Stores current menulevel while counting clicks (keyPress, double or multi-click)
+    uint16_t              m_pollIntervalUS;                           // Timing variables
+    uint16_t              m_longKeyPressMS;
+    uint16_t              m_autoRepeatMS;
+    uint16_t              m_doubleClickMS;
+    uint32_t              m_debounceUS;
+
+    volatile bool         m_blockKeyPress;                            // Boolean flag to prevent firing a keypress if a longPress or AutoRepeatPress occurred (outside of polling fuction)
+    volatile uint16_t     m_validPolls = 0;                           // Variables to conduct debouncing algoritm (Debounce_Polling)
+    volatile uint16_t     m_totalPolls = 0;
+
+    boundAction_t*        eventActions = nullptr;                     // Contiguous table of event actions, NumEventTypes per menu level
+    uint8_t               m_actionRows = 0;                           // Number of menu levels held in the table
+    int16_t               m_ownMenuLevel = -1;                        // Menu level this button follows instead of the class's, -1 when it follows the class
+    bool                  m_singleMenu = false;                       // Only one action row (setSingleMenu()), fixed at menu level 0
+#if IBTN_ASYNC_LANES > 1
+    uint8_t               m_eventLanes[NumEventTypes] = {};           // Asynchronous lane for each event
+#endif
+    bool                  m_ownsActions = false;                      // Table allocated by this button (rather than supplied by InterruptButtonT)
+    struct actionArena_t {                                            // One block holding the tables of a beginGroup(), freed with its last button
+      boundAction_t*        actions;
+      std::atomic<uint8_t>  users;
+    };
+    actionArena_t*        m_arena = nullptr;                          // The block this button's table is part of, if any
+    uint16_t              eventMask = 0b0100000000111;                // Default to keyUp, keyDown, and keyPress enabled, and no blanket disable
+                                                                      // When binding functions, longKeyPress, autoKeyPresses, & double-clicks are automatically enabled.
+
+  public:
+    // Static class members shared by all instances of this object -----------------------
+    static bool     setMode(modes mode);                              // Toggle between Synchronous (Static Queue), Hybrid, or Asynchronous modes (RTOS Queue)
+    static modes    getMode(void);
+    static uint16_t processSyncEvents(uint16_t maxEvents = 0,         // Process Sync Events, called from main looop.  Stops after maxEvents or once
+                                      uint32_t maxMicros = 0);        // maxMicros have passed (0 for no limit), returns the events still waiting
+    static uint16_t pendingSyncEvents(void);                          // Events waiting for processSyncEvents(), doesn't block
+    static void     setMenuCount(uint8_t numberOfMenus);              // Sets number of menus/pages that each button has (can only be done before intialising first button)
+    static uint8_t  getMenuCount(void);                               // Retrieves total number of menus.
+    static void     setMenuLevel(uint8_t level);                      // Sets menu level across all buttons (ie buttons mean something different each page)
+    static uint8_t  getMenuLevel();                                   // Retrieves menu level
+    static void     setSharedTimers(bool shared);                     // Buttons initialised afterwards share one esp_timer instead of three each
+    static bool     getSharedTimers(void);
+    static bool     setTimerDispatch(esp_timer_dispatch_t method);    // ESP_TIMER_ISR times own debounce timers from the timer ISR (where supported)
+    static esp_timer_dispatch_t getTimerDispatch(void);
+    static bool     setLaneTask(uint8_t lane,                         // Priority and core of a lane's servicer task (by default lane n runs at
+                                UBaseType_t priority,                 // priority 2 + n on core 1).  A started servicer takes the new priority
+                                BaseType_t core);                     // but keeps its core; false if the core isn't 0..portNUM_PROCESSORS-1 or tskNO_AFFINITY
+    static bool     setLaneWorkers(uint8_t lane,                      // Share a lane's queue between several servicer tasks (up to IBTN_MAX_WORKERS),
+                                   uint8_t workers,                   // optionally each on its own core; a button's events still run one at a time,
+                                   const BaseType_t cores[] = nullptr); // in order.  Must be set before the lane is started
+    static bool     beginGroup(InterruptButton* const buttons[],      // Initialise many buttons at once: one allocation for their action tables and
+                               uint8_t count);                        // one gpio_config() for all pins set up alike, false if any pin failed
+    static int8_t   addChord(InterruptButton* const buttons[],        // Buttons held down together raise Event_Chord on buttons[0] instead of
+                             uint8_t count);                          // their own keyPress etc, returns the chord's index (evt.data) or -1
+    static void     clearChords(void);
+#if IBTN_HISTORY_DEPTH
+    static void     clearGestures(void);
+#endif
+    static bool     prepareForSleep(bool deepSleep = false);          // Arms the wakeup buttons' pins (gpio wakeup, or ext1 for deep sleep), false if still busy
+    static uint8_t  resumeFromSleep(void);                            // After waking (or booting from deep sleep): replays the wake press, returns buttons replayed
+#if IBTN_STATS
+    static InterruptButtonStats getStats(void);                       // Counters for all buttons since starting (or resetStats())
+    static void     resetStats(void);
+#endif
+    static uint32_t m_RTOSservicerStackDepth;                         // Allows the user to set the depth of RTOS servicer function (for bound functions)
+                                                                      // Must be set before initialsing/binding first button or calling setMode().
+
+    // Non-static instance specific member declarations ----------------------------------
+    InterruptButton(uint8_t pin,                                      // Class Constructor, pin to monitor
+                    uint8_t pressedState,                             // State of the pin when pressed (HIGH or LOW)
+                    gpio_mode_t pinMode = GPIO_MODE_INPUT,
+                    uint16_t longKeyPressMS = 750,
+                    uint16_t autoRepeatMS =   250,
+                    uint16_t doubleClickMS =  333,
+                    uint32_t debounceUS =     8000);
+    ~InterruptButton();                                               // Class Destructor
+
+  private:
+    InterruptButton(const volatile uint32_t* levelWord,               // Matrix key constructor (used by InterruptButtonMatrix)
+                    uint32_t levelMask,
+                    uint16_t longKeyPressMS,
+                    uint16_t autoRepeatMS,
+                    uint16_t doubleClickMS,
+                    uint32_t debounceUS);
+    struct virtualSource_t {};                                        // Selects the virtual source constructor
+    explicit InterruptButton(virtualSource_t);                        // Pin-less event source (used by InterruptEncoder), never pressed
+
+  public:
+
+    void            enableEvent(events event);                        // Enable the event passed as argument (updates bitmask)
+    void            disableEvent(events event);                       // Disable the event passed as argument (updates bitmask)
+    inline bool     eventEnabled(events event) {                      // Read bitmask and determine if event is enabled (and compiled in)
+      return (((IBTN_EVENTS | (1UL << Event_All)) & eventMask) >> event) & 0x01;
+    }
+    static constexpr bool compiledIn(events event) {                  // Handling for the event is built in (IBTN_EVENTS)
+      return event == Event_All || ((IBTN_EVENTS >> event) & 0x01);
+    }
+    void            setLongPressInterval(uint16_t intervalMS);        // Updates LongPress Interval
+    uint16_t        getLongPressInterval(void);
+    void            setAutoRepeatInterval(uint16_t intervalMS);       // Updates autoRepeat Interval
+    uint16_t        getAutoRepeatInterval(void);
+    void            setDoubleClickInterval(uint16_t intervalMS);      // Updates autoRepeat Interval
+    uint16_t        getDoubleClickInterval(void);
+    void            setMaxClicks(uint8_t clicks);                     // Clicks in a row counted before actioning them, 3 or more for Event_MultiClick
+    uint8_t         getMaxClicks(void);
+    void            setDebounceMode(debounceModes mode);              // Select the debounce algorithm for this button
+    debounceModes   getDebounceMode(void);
+    void            setButtonMenuLevel(uint8_t level);                // This button follows its own menu level, setMenuLevel() no longer affects it
+    void            followMenuLevel(void);                            // Back to following the class wide menu level
+    uint8_t         getButtonMenuLevel(void);                         // Menu level this button's events are currently raised at
+    void            setSingleMenu(void);                              // Fixed function button: one action row (level 0) whatever the menu count, call before initialising
+    void            setLane(uint8_t lane);                            // Asynchronous lane for all of this button's events (see IBTN_ASYNC_LANES)
+    void            setEventLane(events event, uint8_t lane);         // Or for one of them
+    uint8_t         getEventLane(events event);
+    void            setCoalesceRepeats(bool enabled);                 // Queue at most one autoRepeat at a time, evt.data counts the repeats it stands for
+    bool            getCoalesceRepeats(void);
+    bool            setWakeup(bool enabled);                          // Use this button to wake the chip (prepareForSleep()), false if it can't be
+    bool            getWakeup(void);
+    void            setFastKeyDown(bool enabled);                     // Send keyDown on the first edge rather than after debouncing
+    bool            getFastKeyDown(void);
+    ButtonEvent     getLastEvent(void);                               // Event being actioned (ie its timestamp), valid from within a bound action
+#if IBTN_HISTORY_DEPTH
+    int8_t          addGesture(const char* pattern);                  // Presses as '.' (short) or '-' (held past the longPress time), ie "..." or ".-",
+                                                                      // raises Event_Gesture, returns the gesture's index (evt.data) or -1
+    uint8_t         getHistory(ButtonHistoryEntry entries[],          // Copies out the history oldest first, returns the number of entries
+                               uint8_t maxEntries);
+    void            clearHistory(void);
+#endif
+#if IBTN_STATS
+    InterruptButtonStats getButtonStats(void);                        // Counters for this button alone
+    void            resetButtonStats(void);
+#endif
+
+
+    // Routines to manage interface with external action functions associated with each event ---
+    void            bind(events     event,                                  // Used to bind an action to an event at a given menulevel
+                         uint8_t    menuLevel,
+                         func_ptr_t action);
+    inline void     bind(events event, func_ptr_t action) { bind(event, menuLevel(), action); } // Above function defaulting to current menulevel
+
+    void            bind(events     event,                                  // Bind a callback receiving a user context and the event record
+                         uint8_t    menuLevel,
+                         event_cb_t callback,
+                         void*      ctx);
+#if __cplusplus >= 201703L
+    template<auto Fn>                                                       // Bind a function known at compile time, void fn() or void fn(const ButtonEvent&)
+    inline void     bind(events event, uint8_t menuLevel) { bind(event, menuLevel, &invokeStatic<Fn>, nullptr); }
+    template<auto Fn>
+    inline void     bind(events event) { bind<Fn>(event, menuLevel()); }
+#endif
+
+    void            unbind(events   event,                                  // Used to unbind an action to an event at a given menulevel
+                           uint8_t  menuLevel);
+    inline void     unbind(events event) { unbind(event, menuLevel()); };   // Above function defaulting to current menulevel
+};
+
+
+// -- Compile time settings for an InterruptButtonT, derive from this and override whatever differs ------------------------
+// -- ----------------------------------------------------------------------------------------------------------------------
+struct InterruptButtonConfig {
+  static constexpr uint16_t       events          = (1 << Event_KeyDown) | (1 << Event_KeyUp) | (1 << Event_KeyPress); // Enabled to start with
+  static constexpr debounceModes  debounce        = Debounce_Polling;
+  static constexpr uint16_t       longKeyPressMS  = 750;      // Constructor defaults
+  static constexpr uint16_t       autoRepeatMS    = 250;
+  static constexpr uint16_t       doubleClickMS   = 333;
+  static constexpr uint32_t       debounceUS      = 8000;
+  static constexpr uint8_t        maxClicks       = 2;
+  static constexpr uint8_t        lane            = 0;        // Asynchronous lane for all of the button's events
+  static constexpr bool           fastKeyDown     = false;
+  static constexpr bool           coalesceRepeats = false;
+};
+
+
+// -- Interrupt Button with the event-action table held within the object (sized at compile time, no heap allocation) -----
+// -- ----------------------------------------------------------------------------------------------------------------------
+template<uint8_t Menus, typename Config = InterruptButtonConfig>
+class InterruptButtonT : public InterruptButton {
+  static_assert(Menus >= 1, "InterruptButtonT requires at least one menu level");
+  static_assert((Config::events & ~(IBTN_EVENTS)) == 0, "Config enables events that IBTN_EVENTS leaves out");
+  static_assert(Config::lane < IBTN_ASYNC_LANES, "Config lane must be below IBTN_ASYNC_LANES");
+  static_assert(Config::maxClicks >= 1, "Config maxClicks must be at least 1");
+
+  public:
+    InterruptButtonT(uint8_t pin,
+                     uint8_t pressedState,
+                     gpio_mode_t pinMode = GPIO_MODE_INPUT,
+                     uint16_t longKeyPressMS = Config::longKeyPressMS,
+                     uint16_t autoRepeatMS =   Config::autoRepeatMS,
+                     uint16_t doubleClickMS =  Config::doubleClickMS,
+                     uint32_t debounceUS =     Config::debounceUS) :
+                     InterruptButton(pin, pressedState, pinMode, longKeyPressMS, autoRepeatMS, doubleClickMS, debounceUS) {
+      useActionStorage(m_actionStorage, Menus);
+      for(uint8_t e = 0; e < NumEventTypes; e++) {
+        if((Config::events >> e) & 1) enableEvent(static_cast<events>(e));
+        else                          disableEvent(static_cast<events>(e));
+      }
+      if(Config::debounce != Debounce_Polling) setDebounceMode(Config::debounce);
+      if(Config::lane != 0) setLane(Config::lane);
+      setMaxClicks(Config::maxClicks);
+      setFastKeyDown(Config::fastKeyDown);
+      setCoalesceRepeats(Config::coalesceRepeats);
+    }
+
+  private:
+    boundAction_t m_actionStorage[Menus * NumEventTypes];
+};
+
+#endif // INTERRUPTBUTTON_H_
@@ -0,0 +1,217 @@
+#include "InterruptButtonMatrix.h"
+
+#include "soc/soc.h"
+#include "soc/gpio_reg.h"
+#include "esp_rom_sys.h"
+#include <new>
+
+// Include reference req'd for debugging and warnings across serial port.
+#ifdef ARDUINO
+#include "esp32-hal-log.h"
+#else
+#include "esp_log.h"
+#endif
+
+static const char* TAG = "IBTN";              // IDF log tag
+
+
+// Constructor ------------------------------------------------------------------
+InterruptButtonMatrix::InterruptButtonMatrix(const uint8_t* rowPins, uint8_t rows, const uint8_t* colPins, uint8_t cols,
+                                             uint16_t longKeyPressMS, uint16_t autoRepeatMS,
+                                             uint16_t doubleClickMS,  uint32_t debounceUS) :
+                                             m_longKeyPressMS(longKeyPressMS),
+                                             m_autoRepeatMS(autoRepeatMS),
+                                             m_doubleClickMS(doubleClickMS),
+                                             m_debounceUS(debounceUS) {
+  if(rows > IBTN_MATRIX_MAX_ROWS || cols > IBTN_MATRIX_MAX_COLS) {
+    ESP_LOGW(TAG, "Matrix limited to %d x %d keys", IBTN_MATRIX_MAX_ROWS, IBTN_MATRIX_MAX_COLS);
+  }
+  m_rows = (rows > IBTN_MATRIX_MAX_ROWS) ? IBTN_MATRIX_MAX_ROWS : rows;
+  m_cols = (cols > IBTN_MATRIX_MAX_COLS) ? IBTN_MATRIX_MAX_COLS : cols;
+  for(uint8_t r = 0; r < m_rows; r++) m_rowPins[r] = static_cast<gpio_num_t>(rowPins[r]);
+  for(uint8_t c = 0; c < m_cols; c++) m_colPins[c] = static_cast<gpio_num_t>(colPins[c]);
+  m_scanIntervalUS = (debounceUS / TARGET_POLLS > 0) ? debounceUS / TARGET_POLLS : 1;  // Same sampling rate as Debounce_Polling
+}
+
+// Destructor --------------------------------------------------------------------
+InterruptButtonMatrix::~InterruptButtonMatrix() {
+  if(m_begun) {
+    m_retiring = true;
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    listen(false);
+    for(uint8_t c = 0; c < m_cols; c++) {
+      gpio_isr_handler_remove(m_colPins[c]);
+      gpio_reset_pin(m_colPins[c]);
+    }
+    for(uint8_t r = 0; r < m_rows; r++) gpio_reset_pin(m_rowPins[r]);
+    InterruptButton::waitUnused(m_inUse);                     // A scan under way may schedule the next, so only then cancel it
+    InterruptButton::cancelDeadline(m_scanDeadline);
+    InterruptButton::waitUnused(m_inUse);                     // and let one the scheduler had already taken see m_retiring
+  }                                                           // Each key waits only on its own callbacks as it goes
+  if(m_keys != nullptr) {
+    for(int k = m_rows * m_cols - 1; k >= 0; k--) m_keys[k].~InterruptButton();
+    ::operator delete(m_keys);
+  }
+  delete [] m_actions;
+}
+
+// Initialiser -------------------------------------------------------------------
+bool InterruptButtonMatrix::begin(void){
+  if(m_begun) return true;
+  InterruptButton::initialiseClass();
+
+  if(!pinsValid()) return false;                              // Before anything is allocated or configured
+  buildKeys();
+
+  gpio_config_t gpio_conf = {};                               // Rows: open-drain so a selected row can't fight another through two keys
+    gpio_conf.mode = GPIO_MODE_OUTPUT_OD;
+    gpio_conf.intr_type = GPIO_INTR_DISABLE;
+  for(uint8_t r = 0; r < m_rows; r++) {
+    gpio_conf.pin_bit_mask |= BIT64(m_rowPins[r]);
+    m_rowMask[m_rowPins[r] >> 5] |= 1UL << (m_rowPins[r] & 31);
+  }
+  gpio_config(&gpio_conf);
+
+  gpio_conf = {};                                             // Columns: pulled up, the interrupt type is set once the handlers are in place
+    gpio_conf.mode = GPIO_MODE_INPUT;
+    gpio_conf.pull_up_en = GPIO_PULLUP_ENABLE;
+    gpio_conf.intr_type = GPIO_INTR_DISABLE;
+  for(uint8_t c = 0; c < m_cols; c++) gpio_conf.pin_bit_mask |= BIT64(m_colPins[c]);
+  gpio_config(&gpio_conf);
+  for(uint8_t c = 0; c < m_cols; c++) {
+    gpio_isr_handler_add(m_colPins[c], &columnISR, reinterpret_cast<void*>(this));
+    gpio_set_intr_type(m_colPins[c], GPIO_INTR_LOW_LEVEL);    // Level, so a press can't slip by while switching back from scanning
+  }
+
+  m_scanDeadline = { 0, nullptr, &scanTimeout, reinterpret_cast<void*>(this), false, &m_inUse };
+  m_begun = true;
+  listen(true);
+  return true;
+}
+
+
+bool InterruptButtonMatrix::pinsValid(void){
+  for(uint8_t r = 0; r < m_rows; r++) {
+    if(!GPIO_IS_VALID_OUTPUT_GPIO(m_rowPins[r])) {
+      ESP_LOGE(TAG, "Matrix row %d: %d is not a valid output gpio on this platform", r, m_rowPins[r]);
+      return false;
+    }
+  }
+  for(uint8_t c = 0; c < m_cols; c++) {
+    if(!GPIO_IS_VALID_GPIO(m_colPins[c])) {
+      ESP_LOGE(TAG, "Matrix column %d: %d is not a valid gpio on this platform", c, m_colPins[c]);
+      return false;
+    }
+  }
+  return true;
+}
+
+void InterruptButtonMatrix::buildKeys(void){
+  if(m_keys != nullptr) return;                               // Keys and their action tables are each one allocation
+  uint16_t count = m_rows * m_cols;
+  uint8_t menus = InterruptButton::m_numMenus;
+  m_actions = new InterruptButton::boundAction_t[count * menus * NumEventTypes];
+  m_keys = static_cast<InterruptButton*>(::operator new(count * sizeof(InterruptButton)));
+  for(uint16_t k = 0; k < count; k++) {
+    InterruptButton* key = new (&m_keys[k]) InterruptButton(&m_keyMap[k >> 5], 1UL << (k & 31), m_longKeyPressMS,
+                                                            m_autoRepeatMS, m_doubleClickMS, m_debounceUS);
+    key->useActionStorage(&m_actions[k * menus * NumEventTypes], menus);
+    key->initialiseInstance();
+  }
+}
+
+
+//-- Key access ------------------------------------------------------------------------------------------
+InterruptButton& InterruptButtonMatrix::key(uint8_t row, uint8_t col){
+  if(!m_begun && !begin()) buildKeys();                       // Auto initialisation, as with binding a button.  With bad pins
+                                                              // the keys are still there to bind, they just never see a press
+  if(row >= m_rows || col >= m_cols) {
+    ESP_LOGE(TAG, "Matrix key %d,%d is outside the %d x %d keypad!", row, col, m_rows, m_cols);
+    row = (row >= m_rows) ? m_rows - 1 : row;
+    col = (col >= m_cols) ? m_cols - 1 : col;
+  }
+  return m_keys[row * m_cols + col];
+}
+
+int16_t InterruptButtonMatrix::keyIndex(const InterruptButton* key){
+  if(m_keys == nullptr || key < m_keys || key >= m_keys + m_rows * m_cols) return -1;
+  return static_cast<int16_t>(key - m_keys);
+}
+
+
+//-- Scanning --------------------------------------------------------------------------------------------
+void IRAM_ATTR InterruptButtonMatrix::columnISR(void* arg){
+  InterruptButtonMatrix* matrix = reinterpret_cast<InterruptButtonMatrix*>(arg);
+  InterruptButton::useGuard guard(&matrix->m_inUse);
+  if(matrix->m_retiring) return;
+  bool wasListening = matrix->m_listening;
+  matrix->listen(false);                                      // Always, a level interrupt would otherwise keep firing
+  if(wasListening) InterruptButton::scheduleDeadline(matrix->m_scanDeadline, esp_timer_get_time());
+}
+
+void InterruptButtonMatrix::scanTimeout(void* arg){
+  InterruptButtonMatrix* matrix = reinterpret_cast<InterruptButtonMatrix*>(arg);
+  InterruptButton::useGuard guard(&matrix->m_inUse);
+  if(!matrix->m_retiring) matrix->scan();
+}
+
+void InterruptButtonMatrix::scan(void){
+  uint32_t keyMap[2] = { 0, 0 };
+  for(uint8_t r = 0; r < m_rows; r++) {                       // One register read per row gives every column
+    selectRow(r);
+    esp_rom_delay_us(IBTN_MATRIX_SETTLE_US);
+    uint32_t in[2] = { REG_READ(GPIO_IN_REG), 0 };
+#if SOC_GPIO_PIN_COUNT > 32
+    in[1] = REG_READ(GPIO_IN1_REG);
+#endif
+    for(uint8_t c = 0; c < m_cols; c++) {
+      uint16_t k = r * m_cols + c;
+      if(!(in[m_colPins[c] >> 5] & (1UL << (m_colPins[c] & 31)))) keyMap[k >> 5] |= 1UL << (k & 31);   // Low is pressed
+    }
+  }
+  selectRow(-1);
+
+  uint32_t changed[2] = { keyMap[0] ^ m_keyMap[0], keyMap[1] ^ m_keyMap[1] };
+  m_keyMap[0] = keyMap[0];
+  m_keyMap[1] = keyMap[1];
+  bool busy = (keyMap[0] | keyMap[1]) != 0;                   // Keep scanning while anything is held or still debouncing
+  for(uint16_t k = 0; k < m_rows * m_cols; k++) {
+    InterruptButton* key = &m_keys[k];
+    if(changed[k >> 5] & (1UL << (k & 31))) InterruptButton::edgeCapture(key);   // A sampled edge, same as a pin's ISR
+    if(key->m_state != InterruptButton::Released) busy = true;
+  }
+  if(busy) {
+    InterruptButton::scheduleDeadline(m_scanDeadline, esp_timer_get_time() + m_scanIntervalUS);
+  } else {
+    listen(true);                                             // All quiet, go back to waiting on an interrupt
+  }
+}
+
+void IRAM_ATTR InterruptButtonMatrix::listen(bool enable){
+  portENTER_CRITICAL_SAFE(&m_listenMux);                      // Don't let a column ISR slip in half way through
+  if(enable) selectRow(-1);
+  m_listening = enable;
+  for(uint8_t c = 0; c < m_cols; c++) {
+    if(enable) gpio_intr_enable(m_colPins[c]); else gpio_intr_disable(m_colPins[c]);
+  }
+  portEXIT_CRITICAL_SAFE(&m_listenMux);
+}
+
+void IRAM_ATTR InterruptButtonMatrix::selectRow(int8_t row){
+  REG_WRITE(GPIO_OUT_W1TS_REG, m_rowMask[0]);                 // Release every row (open-drain, so they float high)
+#if SOC_GPIO_PIN_COUNT > 32
+  REG_WRITE(GPIO_OUT1_W1TS_REG, m_rowMask[1]);
+#endif
+  if(row < 0) {
+    REG_WRITE(GPIO_OUT_W1TC_REG, m_rowMask[0]);               // Then drive the selected row(s) low
+#if SOC_GPIO_PIN_COUNT > 32
+    REG_WRITE(GPIO_OUT1_W1TC_REG, m_rowMask[1]);
+#endif
+  } else {
+    gpio_num_t pin = m_rowPins[row];
+#if SOC_GPIO_PIN_COUNT > 32
+    if(pin >= 32) { REG_WRITE(GPIO_OUT1_W1TC_REG, 1UL << (pin - 32)); return; }
+#endif
+    REG_WRITE(GPIO_OUT_W1TC_REG, 1UL << pin);
+  }
+}
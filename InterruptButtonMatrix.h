@@ -0,0 +1,69 @@
+// Keypad matrix built on InterruptButton, see README.md ("Matrix Keypads").
+
+#ifndef INTERRUPTBUTTONMATRIX_H_
+#define INTERRUPTBUTTONMATRIX_H_
+
+#include "InterruptButton.h"
+
+#define IBTN_MATRIX_MAX_ROWS      8
+#define IBTN_MATRIX_MAX_COLS      8
+
+#ifndef IBTN_MATRIX_SETTLE_US
+#define IBTN_MATRIX_SETTLE_US     2     // Time for the columns to follow after a row is selected (pull-ups vs line capacitance)
+#endif
+
+
+// -- Interrupt driven keypad matrix ---------------------------------------------------------------------------------------
+// -- ----------------------------------------------------------------------------------------------------------------------
+// Rows are open-drain outputs and columns are inputs with pull-ups.  While idle every row is driven low and the columns
+// wait on a low level interrupt, so a press anywhere costs one interrupt.  The keypad is then scanned from the shared
+// timer scheduler, one register read per row for all columns, until every key is released again.  Each key is an
+// InterruptButton with the usual events, menu levels and bindings, debounced by the edge timestamp algorithm.
+class InterruptButtonMatrix {
+  public:
+    InterruptButtonMatrix(const uint8_t* rowPins, uint8_t rows,       // Up to IBTN_MATRIX_MAX_ROWS x IBTN_MATRIX_MAX_COLS
+                          const uint8_t* colPins, uint8_t cols,
+                          uint16_t longKeyPressMS = 750,
+                          uint16_t autoRepeatMS =   250,
+                          uint16_t doubleClickMS =  333,
+                          uint32_t debounceUS =     8000);
+    ~InterruptButtonMatrix();
+
+    bool              begin(void);                                    // Configures the pins and creates the keys, call before using key().  False, with nothing allocated, if a pin is invalid
+    InterruptButton&  key(uint8_t row, uint8_t col);                  // Bind events, enable/disable them etc as for any other button
+    int16_t           keyIndex(const InterruptButton* key);           // row * cols + col of a key (ie evt.button in a callback), -1 if not ours
+    uint8_t           rows(void) { return m_rows; }
+    uint8_t           cols(void) { return m_cols; }
+
+  private:
+    static void       columnISR(void* arg);                           // Any column low: stop listening and start scanning
+    static void       scanTimeout(void* arg);                         // Scheduler deadline: scan the keypad once
+    void              scan(void);
+    void              listen(bool enable);                            // Idle state: all rows low, column interrupts on (or off)
+    void              selectRow(int8_t row);                          // -1 selects every row
+    bool              pinsValid(void);
+    void              buildKeys(void);                                // Allocates the keys and their action tables, no hardware is touched
+
+    uint8_t           m_rows;
+    uint8_t           m_cols;
+    gpio_num_t        m_rowPins[IBTN_MATRIX_MAX_ROWS];
+    gpio_num_t        m_colPins[IBTN_MATRIX_MAX_COLS];
+    uint32_t          m_rowMask[2] = {};                              // Row pins per GPIO bank (0-31, 32+), for the W1TS / W1TC registers
+    uint16_t          m_longKeyPressMS;
+    uint16_t          m_autoRepeatMS;
+    uint16_t          m_doubleClickMS;
+    uint32_t          m_debounceUS;
+    uint32_t          m_scanIntervalUS;
+
+    InterruptButton*  m_keys = nullptr;                               // rows * cols keys in one block
+    InterruptButton::boundAction_t* m_actions = nullptr;              // And their event-action tables, also in one block
+    volatile uint32_t m_keyMap[2] = {};                               // Key pressed bits (row * cols + col) from the last scan
+    InterruptButton::deadline_t m_scanDeadline = {};
+    bool              m_listening = false;
+    portMUX_TYPE      m_listenMux = portMUX_INITIALIZER_UNLOCKED;
+    bool              m_begun = false;
+    volatile bool     m_retiring = false;                             // Being deleted, a scan already due does nothing
+    std::atomic<uint32_t> m_inUse { 0 };                              // Column ISRs and scans under way (useGuard), its keys count their own
+};
+
+#endif // INTERRUPTBUTTONMATRIX_H_
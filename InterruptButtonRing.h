@@ -0,0 +1,97 @@
+// Fixed size FIFO used for the InterruptButton event queues.
+
+#ifndef INTERRUPTBUTTONRING_H_
+#define INTERRUPTBUTTONRING_H_
+
+
+#include "esp_attr.h"
+#include "freertos/FreeRTOS.h"
+#include <atomic>
+#include <utility>
+
+
+// -- Power-of-two ring buffer with atomic head and tail indices -----------------------------------------------------------
+// -- ----------------------------------------------------------------------------------------------------------------------
+// Entries are added by the GPIO ISR's and the esp_timer task (which may be running on either core), so producers are
+// serialised by a spinlock for the few instructions it takes to claim a slot.  There is only ever one consumer (the RTOS
+// servicer or the main loop), which only locks to claim() what it takes.  Head and tail free-run and wrap naturally,
+// masking gives the slot.
+template<typename T, uint16_t Depth>
+class InterruptButtonRing {
+  static_assert(Depth >= 2 && (Depth & (Depth - 1)) == 0, "InterruptButtonRing depth must be a power of two");
+
+  public:
+    // Producer side (ISR safe) - returns false if the ring is full and the entry was dropped
+    inline bool IRAM_ATTR push(const T& item) {
+      bool retVal = false;
+      portENTER_CRITICAL_SAFE(&m_producerMux);
+      uint16_t head = m_head.load(std::memory_order_relaxed);
+      if(static_cast<uint16_t>(head - m_tail.load(std::memory_order_acquire)) < Depth) {
+        m_slots[head & (Depth - 1)] = item;
+        m_head.store(head + 1, std::memory_order_release);      // Publish the entry only once it is fully written
+        retVal = true;
+      }
+      portEXIT_CRITICAL_SAFE(&m_producerMux);
+      return retVal;
+    }
+
+    // Consumer side, claim(item) runs before the producers' lock is released so forEachPending() either still sees the
+    // entry or runs once it is claimed - returns false if the ring is empty
+    template<typename F>
+    inline bool pop(T& item, F claim) {
+      portENTER_CRITICAL_SAFE(&m_producerMux);
+      bool taken = pop(item);
+      if(taken) claim(item);
+      portEXIT_CRITICAL_SAFE(&m_producerMux);
+      return taken;
+    }
+    template<typename F>
+    inline bool peek(T& item, F claim) {
+      portENTER_CRITICAL_SAFE(&m_producerMux);
+      bool found = peek(item);
+      if(found) claim(item);
+      portEXIT_CRITICAL_SAFE(&m_producerMux);
+      return found;
+    }
+
+    // Consumer side - returns false if the ring is empty
+    inline bool pop(T& item) {
+      uint16_t tail = m_tail.load(std::memory_order_relaxed);
+      if(tail == m_head.load(std::memory_order_acquire)) return false;
+      item = std::move(m_slots[tail & (Depth - 1)]);
+      m_tail.store(tail + 1, std::memory_order_release);          // Hand the slot back to the producers
+      return true;
+    }
+
+    // Consumer side - copies the oldest entry without taking it, false if the ring is empty
+    inline bool peek(T& item) const {
+      uint16_t tail = m_tail.load(std::memory_order_relaxed);
+      if(tail == m_head.load(std::memory_order_acquire)) return false;
+      item = m_slots[tail & (Depth - 1)];
+      return true;
+    }
+
+    // Visit entries still waiting to be consumed (ie to invalidate them), holds off the producers while doing so
+    template<typename F>
+    inline void forEachPending(F fn) {
+      portENTER_CRITICAL_SAFE(&m_producerMux);
+      uint16_t head = m_head.load(std::memory_order_acquire);
+      for(uint16_t i = m_tail.load(std::memory_order_acquire); i != head; i++) fn(m_slots[i & (Depth - 1)]);
+      portEXIT_CRITICAL_SAFE(&m_producerMux);
+    }
+
+    inline uint16_t size(void) const {
+      return static_cast<uint16_t>(m_head.load(std::memory_order_acquire) - m_tail.load(std::memory_order_acquire));
+    }
+    inline bool     empty(void) const { return size() == 0; }
+    inline void     clear(void)       { m_tail.store(m_head.load(std::memory_order_acquire), std::memory_order_release); }
+    static constexpr uint16_t depth(void) { return Depth; }
+
+  private:
+    T                     m_slots[Depth] = {};
+    std::atomic<uint16_t> m_head { 0 };                           // Next slot to be written (producers)
+    std::atomic<uint16_t> m_tail { 0 };                           // Next slot to be read (consumer)
+    portMUX_TYPE          m_producerMux = portMUX_INITIALIZER_UNLOCKED;
+};
+
+#endif // INTERRUPTBUTTONRING_H_
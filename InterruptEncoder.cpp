@@ -0,0 +1,96 @@
+#include "InterruptEncoder.h"
+
+#include "soc/soc.h"
+#include "soc/gpio_reg.h"
+
+// Include reference req'd for debugging and warnings across serial port.
+#ifdef ARDUINO
+#include "esp32-hal-log.h"
+#else
+#include "esp_log.h"
+#endif
+
+static const char* TAG = "IBTN";              // IDF log tag
+
+// Step for each (previous << 2 | current) reading of A and B.  Invalid transitions (both pins changed, ie a missed
+// edge) and repeated readings give 0, a bounce on one contact alternates +1 and -1 and so cancels itself out.
+static const DRAM_ATTR int8_t quadratureSteps[16] = { 0, -1,  1,  0,
+                                                      1,  0,  0, -1,
+                                                     -1,  0,  0,  1,
+                                                      0,  1, -1,  0 };
+
+
+// Constructor ------------------------------------------------------------------
+InterruptEncoder::InterruptEncoder(uint8_t pinA, uint8_t pinB, uint8_t stepsPerDetent, bool pullUps) :
+                                   m_pinA(static_cast<gpio_num_t>(pinA)),
+                                   m_pinB(static_cast<gpio_num_t>(pinB)),
+                                   m_stepsPerDetent((stepsPerDetent == 0) ? 1 : (stepsPerDetent > 4) ? 4 : stepsPerDetent),
+                                   m_pullUps(pullUps),
+                                   m_button(InterruptButton::virtualSource_t{}) {
+  m_button.disableEvent(Event_KeyDown);                       // Only Event_Rotate is wanted (it is enabled when bound)
+  m_button.disableEvent(Event_KeyUp);
+  m_button.disableEvent(Event_KeyPress);
+}
+
+// Destructor --------------------------------------------------------------------
+InterruptEncoder::~InterruptEncoder() {
+  if(!m_begun) return;
+  gpio_isr_handler_remove(m_pinA);
+  gpio_isr_handler_remove(m_pinB);
+  gpio_reset_pin(m_pinA);
+  gpio_reset_pin(m_pinB);
+}
+
+// Initialiser -------------------------------------------------------------------
+bool InterruptEncoder::begin(void){
+  if(m_begun) return true;
+  if(!GPIO_IS_VALID_GPIO(m_pinA) || !GPIO_IS_VALID_GPIO(m_pinB) || m_pinA == m_pinB) {
+    ESP_LOGE(TAG, "Encoder pins %d and %d are not two valid gpios on this platform", m_pinA, m_pinB);
+    return false;
+  }
+  m_button.initialiseInstance();                              // Also installs the GPIO ISR service, if no button has yet
+
+  gpio_config_t gpio_conf = {};
+    gpio_conf.mode = GPIO_MODE_INPUT;
+    gpio_conf.pin_bit_mask = BIT64(m_pinA) | BIT64(m_pinB);
+    gpio_conf.pull_up_en = m_pullUps ? GPIO_PULLUP_ENABLE : GPIO_PULLUP_DISABLE;
+    gpio_conf.intr_type = GPIO_INTR_ANYEDGE;
+  gpio_config(&gpio_conf);
+  uint8_t pins = readPins();
+  m_state = static_cast<uint8_t>((pins << 2) | pins);
+  gpio_isr_handler_add(m_pinA, &edgeISR, reinterpret_cast<void*>(this));
+  gpio_isr_handler_add(m_pinB, &edgeISR, reinterpret_cast<void*>(this));
+  m_begun = true;
+  return true;
+}
+
+
+//-- Decoding --------------------------------------------------------------------------------------------
+inline uint8_t IRAM_ATTR InterruptEncoder::readPins(void){
+  uint32_t in[2] = { REG_READ(GPIO_IN_REG), 0 };
+#if SOC_GPIO_PIN_COUNT > 32
+  in[1] = REG_READ(GPIO_IN1_REG);
+#endif
+  uint8_t a = (in[m_pinA >> 5] >> (m_pinA & 31)) & 1, b = (in[m_pinB >> 5] >> (m_pinB & 31)) & 1;
+  return static_cast<uint8_t>((a << 1) | b);
+}
+
+void IRAM_ATTR InterruptEncoder::edgeISR(void* arg){
+  InterruptEncoder* enc = reinterpret_cast<InterruptEncoder*>(arg);
+  InterruptButton::useGuard guard(&enc->m_button.m_inUse);    // The encoder goes when its button does, which waits for this
+  int16_t detents = 0;
+  portENTER_CRITICAL_SAFE(&enc->m_mux);                       // The two pins' interrupts may be taken on either core
+  enc->m_state = static_cast<uint8_t>(((enc->m_state << 2) | enc->readPins()) & 0x0F);
+  int8_t steps = static_cast<int8_t>(enc->m_steps + quadratureSteps[enc->m_state]);
+  if(steps >= enc->m_stepsPerDetent || steps <= -enc->m_stepsPerDetent) {
+    detents = (steps > 0) ? 1 : -1;
+    steps = 0;
+    enc->m_position += detents;
+  }
+  enc->m_steps = steps;
+  portEXIT_CRITICAL_SAFE(&enc->m_mux);
+  if(detents != 0) {
+    InterruptButton &btn = enc->m_button;
+    InterruptButton::action(&btn, Event_Rotate, btn.menuLevel(), static_cast<uint32_t>(esp_timer_get_time()), detents);
+  }
+}
@@ -0,0 +1,45 @@
+// Quadrature rotary encoder built on InterruptButton, see README.md ("Rotary Encoders").
+
+#ifndef INTERRUPTENCODER_H_
+#define INTERRUPTENCODER_H_
+
+#include "InterruptButton.h"
+
+
+// -- Interrupt driven quadrature encoder ----------------------------------------------------------------------------------
+// -- ----------------------------------------------------------------------------------------------------------------------
+// Both pins interrupt on any edge through the GPIO ISR service the buttons use.  Each edge steps a table driven
+// quadrature decoder (a contact bouncing just steps back and forth, so no debounce timer is needed) and every
+// stepsPerDetent steps are sent as Event_Rotate on the buttons' queues.  While one is waiting to be actioned further
+// detents are added to it, so a fast spin costs one queue entry and evt.data carries the (signed) detents turned.
+class InterruptEncoder {
+  public:
+    InterruptEncoder(uint8_t pinA, uint8_t pinB,                      // Clockwise when A leads B
+                     uint8_t stepsPerDetent = 4,                      // Quadrature steps per click (4, 2 or 1 depending on the encoder)
+                     bool pullUps = true);                            // Internal pull-ups for a common to ground encoder
+    ~InterruptEncoder();
+
+    bool              begin(void);                                    // Configures the pins and starts decoding, bind()ing also calls it
+    InterruptButton&  button(void) { return m_button; }               // Bind Event_Rotate, set its lane etc as for any button (evt.button is this)
+    inline void       bind(events event, uint8_t menuLevel, event_cb_t callback, void* ctx) { begin(); m_button.bind(event, menuLevel, callback, ctx); }
+    inline void       bind(events event, uint8_t menuLevel, func_ptr_t action) { begin(); m_button.bind(event, menuLevel, action); }
+    int32_t           position(void) { return m_position; }           // Detents turned since begin(), counted as they happen (not when actioned)
+    void              setPosition(int32_t position) { m_position = position; }
+
+  private:
+    static void       edgeISR(void* arg);                             // Either pin changed: step the decoder
+    inline uint8_t    readPins(void);                                 // Both pins in one register read, A as bit 1 and B as bit 0
+
+    gpio_num_t        m_pinA;
+    gpio_num_t        m_pinB;
+    uint8_t           m_stepsPerDetent;
+    bool              m_pullUps;
+    volatile uint8_t  m_state = 0;                                    // Last two pin readings, previous in bits 3-2
+    volatile int8_t   m_steps = 0;                                    // Steps towards the next detent
+    volatile int32_t  m_position = 0;
+    portMUX_TYPE      m_mux = portMUX_INITIALIZER_UNLOCKED;
+    InterruptButton   m_button;                                       // Virtual source raising the events, has no pin of its own
+    bool              m_begun = false;
+};
+
+#endif // INTERRUPTENCODER_H_
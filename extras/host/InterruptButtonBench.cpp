@@ -0,0 +1,821 @@
+// Host benchmark for InterruptButton: replays bouncing button waveforms through the real state machine (see host_sim.h)
+// and reports the events produced, the interrupt and timer load per edge, and the edge-to-callback latency for each
+// combination of mode and debounce setting.
+//
+//   InterruptButtonBench [--presses N] [--buttons N] [--seed N] [--loop-ms N] [--bounce-us N] [--glitches] [--wave file.csv]
+//                        [--sync-budget N]
+//
+// The same presses are also typed on a simulated 4 x 4 InterruptButtonMatrix keypad, and pairs of buttons are pressed
+// together as a chord.  Long holds under a slow main loop compare plain and coalesced autoRepeats, and a button is
+// hot-plugged while the others are in use.
+// Waveforms are synthetic and repeatable for a given seed, or --wave replays a recording on the first button.  Recordings
+// are CSV lines of "time_us,level" (raw pin level, the buttons are active LOW), ie exported from a logic analyser.
+// Exits non-zero if any configuration produced the wrong number of events for the synthetic presses.
+//
+// InterruptButtonBenchStats is the same program built with IBTN_STATS, adding the library's getStats() counters, and
+// IBTN_HISTORY_DEPTH, adding bursts of presses matched as gestures.  It also counts the IBTN_TRACE records, which must
+// agree with the stats.
+
+#include "InterruptButton.h"
+#include "InterruptButtonMatrix.h"
+#include "InterruptEncoder.h"
+#include "host_sim.h"
+#include "esp_sleep.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <initializer_list>
+#include <map>
+#include <mutex>
+#include <vector>
+
+
+// -- Waveforms ------------------------------------------------------------------------------------------------------------
+// -- ----------------------------------------------------------------------------------------------------------------------
+struct edge_t {
+  int64_t timeUS;
+  uint8_t button;
+  uint8_t level;
+};
+
+struct options_t {
+  int         presses = 200;            // Per button
+  int         buttons = 4;
+  uint32_t    seed = 1;
+  int         loopMS = 10;              // Main loop period for processSyncEvents()
+  int         bounceUS = 1500;          // Longest bounce burst after each transition
+  bool        glitches = false;         // Add short spikes to the idle line that must not produce a keyPress
+  int         syncBudget = 0;           // Events the main loop processes each time round (0 for all of them)
+  const char* wave = nullptr;
+};
+
+static const int FIRST_PIN = 4;
+
+static uint32_t s_rng = 1;
+static uint32_t rnd(uint32_t lo, uint32_t hi) {        // xorshift32, inclusive range
+  s_rng ^= s_rng << 13; s_rng ^= s_rng >> 17; s_rng ^= s_rng << 5;
+  return lo + s_rng % (hi - lo + 1);
+}
+
+// A transition to 'level' at t, followed by a burst of bounces that always ends back at 'level'
+static int64_t addTransition(std::vector<edge_t> &edges, int64_t t, uint8_t button, uint8_t level, int bounceUS) {
+  edges.push_back({ t, button, level });
+  int64_t end = t + bounceUS;
+  for(uint32_t b = rnd(0, 4); b > 0; b--) {
+    int64_t away = t + rnd(20, 300), back = away + rnd(20, 300);
+    if(back > end) break;
+    edges.push_back({ away, button, static_cast<uint8_t>(!level) });
+    edges.push_back({ back, button, level });
+    t = back;
+  }
+  return t;
+}
+
+static std::vector<edge_t> syntheticWave(const options_t &opt, int64_t startUS) {
+  std::vector<edge_t> edges;
+  s_rng = opt.seed ? opt.seed : 1;
+  for(int b = 0; b < opt.buttons; b++) {
+    int64_t t = startUS + rnd(0, 50000);
+    for(int p = 0; p < opt.presses; p++) {
+      t = addTransition(edges, t, b, 0, opt.bounceUS);                  // Press (active LOW)
+      t += rnd(40, 300) * 1000;                                         // Held, shorter than the longPress default
+      t = addTransition(edges, t, b, 1, opt.bounceUS);                  // Release
+      t += rnd(60, 250) * 1000;
+      if(opt.glitches && rnd(0, 3) == 0) {                              // A noise spike on the idle line
+        edges.push_back({ t, static_cast<uint8_t>(b), 0 });
+        edges.push_back({ t + rnd(5, 200), static_cast<uint8_t>(b), 1 });
+        t += 30000;
+      }
+    }
+  }
+  std::stable_sort(edges.begin(), edges.end(), [](const edge_t &a, const edge_t &b) { return a.timeUS < b.timeUS; });
+  return edges;
+}
+
+static bool loadWave(const char* path, int64_t startUS, std::vector<edge_t> &edges) {
+  FILE* f = fopen(path, "r");
+  if(f == nullptr) { fprintf(stderr, "Can't open %s\n", path); return false; }
+  char line[128];
+  int64_t firstUS = -1;
+  while(fgets(line, sizeof(line), f)) {
+    long long timeUS; int level;
+    if(sscanf(line, "%lld,%d", &timeUS, &level) != 2) continue;        // Skips a header line or blanks
+    if(firstUS < 0) firstUS = timeUS;
+    edges.push_back({ startUS + (timeUS - firstUS), 0, static_cast<uint8_t>(level ? 1 : 0) });
+  }
+  fclose(f);
+  return !edges.empty();
+}
+
+
+// -- Results --------------------------------------------------------------------------------------------------------------
+// -- ----------------------------------------------------------------------------------------------------------------------
+struct result_t {
+  uint32_t              count[NumEventTypes] = {};
+  std::vector<uint32_t> keyDownLatencyUS;       // First edge of the press to the keyDown callback
+  std::vector<uint32_t> allLatencyUS;
+  uint32_t              repeats = 0;            // AutoRepeats, counting those each coalesced event stands for
+  uint32_t              orderErrors = 0;        // A button's keyDown and keyUp arriving out of turn
+  int32_t               rotation = 0;           // Detents turned, adding up Event_Rotate's evt.data
+  uint32_t              gestures[4] = {};       // Event_Gesture, by evt.data
+  uint32_t              clicks = 0;             // Adding up Event_DoubleClick and Event_MultiClick's evt.data
+  uint32_t              elsewhere = 0;          // Dispatched to buttons left out of the counts (ie a hot-plugged one)
+  std::map<const InterruptButton*, bool> down;
+  std::mutex            lock;                   // A worker pool can run callbacks side by side
+};
+
+#if IBTN_TRACE == 2
+static std::atomic<uint32_t> s_traced[NumTracePoints];          // Trace records of each kind since the run began
+
+void ibtnTrace(uint8_t point, uint32_t buttonId, uint32_t value) {
+  (void)buttonId; (void)value;
+  s_traced[point]++;
+}
+#endif
+
+static void clearCounters(void) {                               // At the start of each run
+  hostsim::clearStats();
+#if IBTN_STATS
+  InterruptButton::resetStats();
+#endif
+#if IBTN_TRACE == 2
+  for(auto &n : s_traced) n = 0;
+#endif
+}
+
+static void onEvent(void* ctx, const ButtonEvent &evt) {
+  result_t* r = static_cast<result_t*>(ctx);
+  std::lock_guard<std::mutex> guard(r->lock);
+  uint32_t latencyUS = static_cast<uint32_t>(hostsim::now()) - evt.timestampUS;
+  r->count[evt.event]++;
+  if(evt.event == Event_KeyDown || evt.event == Event_KeyUp) {
+    bool &isDown = r->down[evt.button];
+    if(isDown == (evt.event == Event_KeyDown)) r->orderErrors++;
+    isDown = (evt.event == Event_KeyDown);
+  }
+  if(evt.event == Event_AutoRepeatPress) r->repeats += static_cast<uint32_t>(evt.data);
+  if(evt.event == Event_Rotate) r->rotation += evt.data;
+  if(evt.event == Event_Gesture && evt.data >= 0 && evt.data < 4) r->gestures[evt.data]++;
+  if(evt.event == Event_DoubleClick || evt.event == Event_MultiClick) r->clicks += static_cast<uint32_t>(evt.data);
+  r->allLatencyUS.push_back(latencyUS);
+  if(evt.event == Event_KeyDown) r->keyDownLatencyUS.push_back(latencyUS);
+}
+
+static uint32_t percentile(std::vector<uint32_t> &v, int pct) {
+  if(v.empty()) return 0;
+  std::sort(v.begin(), v.end());
+  return v[(v.size() - 1) * pct / 100];
+}
+
+
+// -- Benchmark run --------------------------------------------------------------------------------------------------------
+// -- ----------------------------------------------------------------------------------------------------------------------
+struct config_t {
+  modes         mode;
+  debounceModes debounce;
+  bool          shared;
+  bool          fast;
+  uint32_t      debounceUS;
+  bool          isrTimers = false;      // Own debounce timers called back from the timer ISR (setTimerDispatch())
+};
+
+static const char* modeName(modes m) {
+  return (m == Mode_Asynchronous) ? "async" : (m == Mode_Hybrid) ? "hybrid" : "sync";
+}
+
+static const char* debounceName(debounceModes d) {
+  return (d == Debounce_Polling) ? "polling" : (d == Debounce_EdgeTimestamp) ? "edge" : (d == Debounce_Batched) ? "batched" :
+         (d == Debounce_PulseCounter) ? "pcnt" : "hardware";
+}
+
+static void bindAll(InterruptButton &btn, const config_t &cfg, result_t &result) {
+  btn.setFastKeyDown(cfg.fast);
+  btn.bind(Event_KeyDown, 0, &onEvent, &result);
+  btn.bind(Event_KeyUp, 0, &onEvent, &result);
+  btn.bind(Event_KeyPress, 0, &onEvent, &result);
+}
+
+// Replays the edges with apply(), running the main loop every loopMS.  Returns the host time taken (s).
+template<typename F>
+static double replay(const std::vector<edge_t> &edges, const options_t &opt, F apply) {
+  int64_t loopUS = static_cast<int64_t>(opt.loopMS) * 1000, nextLoopUS = edges.front().timeUS;
+  auto advance = [&](int64_t toUS) {                              // Move time on, running the main loop as we go
+    while(nextLoopUS <= toUS) {
+      hostsim::advanceTo(nextLoopUS);
+      InterruptButton::processSyncEvents(static_cast<uint16_t>(opt.syncBudget));
+      nextLoopUS += loopUS;
+    }
+    hostsim::advanceTo(toUS);
+  };
+
+  clearCounters();
+  auto wallStart = std::chrono::steady_clock::now();
+  for(const edge_t &e : edges) {
+    advance(e.timeUS);
+    apply(e);
+  }
+  advance(edges.back().timeUS + 2000000);                         // Let every button settle and its events drain
+  InterruptButton::processSyncEvents();                           // and the main loop run once more, however slow it is
+  return std::chrono::duration<double>(std::chrono::steady_clock::now() - wallStart).count();
+}
+
+static bool pressesOk(const config_t &cfg, const result_t &result, uint32_t expected, bool glitches) {
+  uint32_t down = result.count[Event_KeyDown], up = result.count[Event_KeyUp], press = result.count[Event_KeyPress];
+  return (press == expected) && (down == up) && (result.orderErrors == 0) &&                  // Only glitches may add a (retracted) fast keyDown
+         ((cfg.fast && glitches) ? down >= expected : down == expected);
+}
+
+static bool report(const config_t &cfg, const char* debounce, const char* timers, const result_t &result, bool ok, double wallS) {
+  hostsim::counters s = hostsim::stats();
+  uint32_t total = 0;
+  for(int e = 0; e < NumEventTypes; e++) total += result.count[e];
+  uint32_t down = result.count[Event_KeyDown], up = result.count[Event_KeyUp], press = result.count[Event_KeyPress];
+
+#if IBTN_STATS
+  InterruptButtonStats stats = InterruptButton::getStats();                 // Cross-check the library's own counters
+  ok = ok && stats.dispatched == total + result.elsewhere;
+#if IBTN_TRACE == 2
+  ok = ok && s_traced[Trace_DispatchBegin] == stats.dispatched && s_traced[Trace_DispatchEnd] == stats.dispatched &&
+       s_traced[Trace_Enqueue] == stats.asyncQueue.enqueued + stats.syncQueue.enqueued;
+#endif
+#endif
+
+  std::vector<uint32_t> keyDownLatencyUS = result.keyDownLatencyUS, allLatencyUS = result.allLatencyUS;
+  double edges_ = s.edges ? static_cast<double>(s.edges) : 1.0;
+  printf("%-6s %-9s %-6s %-4s %5lu | %6u %6u %6u | %5.2f %5.2f %6.0f | %6u %6u %6u %6u | %6u %6u | %9.0f",
+         modeName(cfg.mode), debounce, timers, cfg.fast ? "fast" : "-", static_cast<unsigned long>(cfg.debounceUS),
+         down, up, press,
+         s.isrCalls / edges_, s.timerCalls / edges_, s.handlerNs / static_cast<double>(s.isrCalls + s.timerCalls + 1),
+         percentile(keyDownLatencyUS, 0), percentile(keyDownLatencyUS, 50),
+         percentile(keyDownLatencyUS, 99), percentile(keyDownLatencyUS, 100),
+         percentile(allLatencyUS, 50), percentile(allLatencyUS, 99),
+         wallS > 0 ? total / wallS : 0.0);
+#if IBTN_STATS
+  printf(" | %6lu %6lu %5lu %5u %5u %6lu", static_cast<unsigned long>(stats.edges), static_cast<unsigned long>(stats.falseAlarms),
+         static_cast<unsigned long>(stats.asyncQueue.dropped + stats.syncQueue.dropped),
+         stats.asyncQueue.highWater, stats.syncQueue.highWater, static_cast<unsigned long>(stats.latencyAvgUS()));
+#endif
+  printf(" %s\n", ok ? "" : "MISMATCH");
+  return ok;
+}
+
+static bool runButtons(const config_t &cfg, const options_t &opt) {
+  InterruptButton::setMode(cfg.mode);
+  InterruptButton::setSharedTimers(cfg.shared);
+  InterruptButton::setTimerDispatch(cfg.isrTimers ? ESP_TIMER_ISR : ESP_TIMER_TASK);
+
+  int numButtons = opt.wave ? 1 : opt.buttons;
+  result_t result;
+  std::vector<InterruptButton*> buttons;
+  for(int b = 0; b < numButtons; b++) {
+    InterruptButton* btn = new InterruptButton(FIRST_PIN + b, 0, GPIO_MODE_INPUT, 750, 250, 333, cfg.debounceUS);
+    btn->setDebounceMode(cfg.debounce);
+#if IBTN_ASYNC_LANES > 1
+    if(b & 1) btn->setLane(1);                                    // Every other button keeps its events out of lane 0
+#endif
+    bindAll(*btn, cfg, result);
+    buttons.push_back(btn);
+  }
+
+  int64_t startUS = hostsim::now() + 1000;
+  std::vector<edge_t> edges;
+  if(opt.wave) {
+    if(!loadWave(opt.wave, startUS, edges)) return false;
+  } else {
+    edges = syntheticWave(opt, startUS);
+  }
+
+  double wallS = replay(edges, opt, [](const edge_t &e) { hostsim::setLevel(FIRST_PIN + e.button, e.level); });
+  bool ok = report(cfg, debounceName(cfg.debounce), cfg.shared ? "shared" : cfg.isrTimers ? "isr" : "own", result,
+                   opt.wave || pressesOk(cfg, result, static_cast<uint32_t>(opt.presses * opt.buttons), opt.glitches), wallS);
+  for(InterruptButton* btn : buttons) delete btn;
+  InterruptButton::setTimerDispatch(ESP_TIMER_TASK);
+  return ok;
+}
+
+// A 4 x 4 keypad, keys pressed one after another with some rollover (never more than two down, so no ghost keys)
+static const uint8_t MATRIX_ROWS[] = { 12, 13, 14, 15 };
+static const uint8_t MATRIX_COLS[] = { 16, 17, 18, 19 };
+static const int     MATRIX_KEYS = sizeof(MATRIX_ROWS) * sizeof(MATRIX_COLS);
+
+static std::vector<edge_t> matrixWave(const options_t &opt, int presses, int64_t startUS) {
+  std::vector<edge_t> edges;
+  s_rng = opt.seed ? opt.seed : 1;
+  int64_t t = startUS;
+  uint8_t key = 0;
+  for(int p = 0; p < presses; p++) {
+    key = static_cast<uint8_t>((key + rnd(1, MATRIX_KEYS - 1)) % MATRIX_KEYS);       // Never the key that may still be down
+    addTransition(edges, t, key, 0, opt.bounceUS);
+    int64_t releaseUS = t + rnd(40, 300) * 1000;
+    addTransition(edges, releaseUS, key, 1, opt.bounceUS);
+    t = (rnd(0, 3) == 0) ? releaseUS - rnd(2, 20) * 1000 : releaseUS + rnd(60, 250) * 1000;
+  }
+  std::stable_sort(edges.begin(), edges.end(), [](const edge_t &a, const edge_t &b) { return a.timeUS < b.timeUS; });
+  return edges;
+}
+
+static bool runMatrix(const config_t &cfg, const options_t &opt) {
+  InterruptButton::setMode(cfg.mode);
+  result_t result;
+  InterruptButtonMatrix* keypad = new InterruptButtonMatrix(MATRIX_ROWS, sizeof(MATRIX_ROWS), MATRIX_COLS, sizeof(MATRIX_COLS),
+                                                            750, 250, 333, cfg.debounceUS);
+  for(uint8_t r = 0; r < keypad->rows(); r++)
+    for(uint8_t c = 0; c < keypad->cols(); c++) bindAll(keypad->key(r, c), cfg, result);
+
+  int presses = opt.presses * opt.buttons;
+  std::vector<edge_t> edges = matrixWave(opt, presses, hostsim::now() + 1000);
+  double wallS = replay(edges, opt, [](const edge_t &e) {
+    hostsim::setSwitch(MATRIX_ROWS[e.button / sizeof(MATRIX_COLS)], MATRIX_COLS[e.button % sizeof(MATRIX_COLS)], e.level == 0);
+  });
+  bool ok = report(cfg, "matrix", "sched", result, pressesOk(cfg, result, static_cast<uint32_t>(presses), false), wallS);
+  delete keypad;
+  return ok;
+}
+
+// Two buttons pressed together (in either order) should give one Event_Chord and no keyPress from either
+static bool runChord(const config_t &cfg, const options_t &opt) {
+  InterruptButton::setMode(cfg.mode);
+  InterruptButton::setSharedTimers(cfg.shared);
+  result_t result;
+  InterruptButton* buttons[2];
+  for(int b = 0; b < 2; b++) {
+    buttons[b] = new InterruptButton(FIRST_PIN + b, 0, GPIO_MODE_INPUT, 750, 250, 333, cfg.debounceUS);
+    buttons[b]->setDebounceMode(cfg.debounce);
+    bindAll(*buttons[b], cfg, result);
+    buttons[b]->bind(Event_LongKeyPress, 0, &onEvent, &result);
+  }
+  buttons[0]->bind(Event_Chord, 0, &onEvent, &result);
+  InterruptButton::addChord(buttons, 2);
+
+  std::vector<edge_t> edges;
+  s_rng = opt.seed ? opt.seed : 1;
+  int64_t t = hostsim::now() + 1000;
+  int presses = opt.presses;
+  for(int p = 0; p < presses; p++) {
+    uint8_t first = static_cast<uint8_t>(rnd(0, 1));
+    int64_t secondUS = t + rnd(20, 80) * 1000, releaseUS = secondUS + rnd(100, 1500) * 1000;   // Some held past a longPress
+    addTransition(edges, t, first, 0, opt.bounceUS);
+    addTransition(edges, secondUS, first ^ 1, 0, opt.bounceUS);
+    addTransition(edges, releaseUS, first, 1, opt.bounceUS);
+    addTransition(edges, releaseUS + rnd(0, 50) * 1000, first ^ 1, 1, opt.bounceUS);
+    t = releaseUS + rnd(200, 600) * 1000;
+  }
+  std::stable_sort(edges.begin(), edges.end(), [](const edge_t &a, const edge_t &b) { return a.timeUS < b.timeUS; });
+
+  double wallS = replay(edges, opt, [](const edge_t &e) { hostsim::setLevel(FIRST_PIN + e.button, e.level); });
+  bool ok = result.count[Event_Chord] == static_cast<uint32_t>(presses) && result.count[Event_KeyPress] == 0 &&
+            result.count[Event_LongKeyPress] == 0 && result.count[Event_KeyDown] == static_cast<uint32_t>(2 * presses) &&
+            result.count[Event_KeyUp] == result.count[Event_KeyDown];
+  ok = report(cfg, debounceName(cfg.debounce), "chord", result, ok, wallS);
+  InterruptButton::clearChords();
+  for(InterruptButton* btn : buttons) delete btn;
+  return ok;
+}
+
+// Bursts of 1 to 4 clicks with double and multi-clicks bound, counting up to 3.  Singles must give a keyPress, pairs a
+// doubleClick and triples a multiClick; a fourth click starts again, so it is a keyPress once the double-click time is up.
+struct clicksConfig : InterruptButtonConfig {                     // Counting up to triple clicks, set at compile time
+  static constexpr uint8_t maxClicks = 3;
+};
+
+static bool runClicks(const config_t &cfg, const options_t &opt, bool multiOnly) {
+  InterruptButton::setMode(cfg.mode);
+  InterruptButton::setSharedTimers(cfg.shared);
+  result_t result;
+  auto* btn = new InterruptButtonT<1, clicksConfig>(FIRST_PIN, 0, GPIO_MODE_INPUT, 750, 250, 333, cfg.debounceUS);
+  btn->setDebounceMode(cfg.debounce);
+  bindAll(*btn, cfg, result);
+  if(!multiOnly) btn->bind(Event_DoubleClick, 0, &onEvent, &result);  // Otherwise double clicks must arrive as multiClicks
+  btn->bind(Event_MultiClick, 0, &onEvent, &result);
+
+  std::vector<edge_t> edges;
+  s_rng = opt.seed ? opt.seed : 1;
+  int64_t t = hostsim::now() + 1000;
+  uint32_t expected[3] = {};                                      // keyPress, doubleClick, multiClick
+  for(int burst = 0; burst < opt.presses; burst++) {
+    uint32_t clicks = rnd(1, 4);
+    for(uint32_t c = 0; c < clicks; c++) {
+      t = addTransition(edges, t, 0, 0, opt.bounceUS) + rnd(40, 200) * 1000;
+      t = addTransition(edges, t, 0, 1, opt.bounceUS) + rnd(60, 250) * 1000;   // The next click begins well within the 333ms
+    }
+    if(clicks == 4) { expected[2]++; expected[0]++; } else expected[clicks - 1]++;
+    t += rnd(500, 900) * 1000;
+  }
+  double wallS = replay(edges, opt, [](const edge_t &e) { hostsim::setLevel(FIRST_PIN + e.button, e.level); });
+  uint32_t clicks = 2 * expected[1] + 3 * expected[2];
+  if(multiOnly) {
+    expected[2] += expected[1];
+    expected[1] = 0;
+  }
+  bool ok = result.count[Event_KeyPress] == expected[0] && result.count[Event_DoubleClick] == expected[1] &&
+            result.count[Event_MultiClick] == expected[2] && result.clicks == clicks;
+  printf("%-8s single %5lu double %5lu multi %5lu      | ", multiOnly ? "multi" : "clicks", static_cast<unsigned long>(result.count[Event_KeyPress]),
+         static_cast<unsigned long>(result.count[Event_DoubleClick]), static_cast<unsigned long>(result.count[Event_MultiClick]));
+  ok = report(cfg, debounceName(cfg.debounce), "clicks", result, ok, wallS);
+  delete btn;
+  return ok;
+}
+
+// Long holds under a main loop too slow to keep up with the autoRepeats.  Coalesced, every repeat must still arrive.
+static bool runRepeat(const config_t &cfg, const options_t &opt, bool coalesce, int loopMS, uint32_t &reference) {
+  InterruptButton::setMode(cfg.mode);
+  InterruptButton::setSharedTimers(cfg.shared);
+  result_t result;
+  InterruptButton* btn = new InterruptButton(FIRST_PIN, 0, GPIO_MODE_INPUT, 750, 100, 333, cfg.debounceUS);
+  btn->setDebounceMode(cfg.debounce);
+  btn->setCoalesceRepeats(coalesce);
+  bindAll(*btn, cfg, result);
+  btn->bind(Event_AutoRepeatPress, 0, &onEvent, &result);
+
+  std::vector<edge_t> edges;
+  s_rng = opt.seed ? opt.seed : 1;
+  int64_t t = hostsim::now() + 1000;
+  for(int p = 0; p < 10; p++) {
+    t = addTransition(edges, t, 0, 0, opt.bounceUS) + rnd(500, 4000) * 1000;
+    t = addTransition(edges, t, 0, 1, opt.bounceUS) + rnd(200, 600) * 1000;
+  }
+  options_t slow = opt;
+  slow.loopMS = loopMS;
+  slow.syncBudget = 0;                                            // The slow loop is what's being measured, it takes everything
+  double wallS = replay(edges, slow, [](const edge_t &e) { hostsim::setLevel(FIRST_PIN + e.button, e.level); });
+  bool ok = true;
+  if(!coalesce && loopMS == opt.loopMS) reference = result.repeats;  // Kept up with, so nothing was dropped
+  else if(coalesce) ok = (result.repeats == reference) && reference > 0;
+  char label[16];
+  snprintf(label, sizeof(label), "%s%d", coalesce ? "coal" : "rpt", loopMS);
+  printf("%-8s repeats %5lu (reference %5lu) in %4lu events | ", label, static_cast<unsigned long>(result.repeats),
+         static_cast<unsigned long>(reference), static_cast<unsigned long>(result.count[Event_AutoRepeatPress]));
+  ok = report(cfg, debounceName(cfg.debounce), "repeat", result, ok, wallS);
+  delete btn;
+  return ok;
+}
+
+// Presses that wake the chip: one during light sleep (its edge raises no ISR) and two across deep sleep "reboots", one
+// still held and one already let go when the button is set up again.  resumeFromSleep() must turn each into a press.
+static bool runWake(const config_t &cfg, const options_t &opt) {
+  InterruptButton::setMode(cfg.mode);
+  InterruptButton::setSharedTimers(cfg.shared);
+  result_t result;
+  auto newButton = [&]() {
+    InterruptButton* btn = new InterruptButton(FIRST_PIN, 0, GPIO_MODE_INPUT, 750, 250, 333, cfg.debounceUS);
+    btn->setDebounceMode(cfg.debounce);
+    bindAll(*btn, cfg, result);
+    btn->setWakeup(true);
+    return btn;
+  };
+  auto runFor = [&](int ms) {                                     // Main loop running as in replay()
+    int64_t endUS = hostsim::now() + ms * 1000;
+    for(int64_t t = hostsim::now() + opt.loopMS * 1000; t <= endUS; t += opt.loopMS * 1000) {
+      hostsim::advanceTo(t);
+      InterruptButton::processSyncEvents();
+    }
+    hostsim::advanceTo(endUS);
+    hostsim::waitIdle();
+  };
+
+  clearCounters();
+  auto wallStart = std::chrono::steady_clock::now();
+  InterruptButton* btn = newButton();
+  result_t other;                                                 // Not a wakeup source, but held it must still keep the chip awake
+  InterruptButton* held = new InterruptButton(FIRST_PIN + 1, 0, GPIO_MODE_INPUT, 750, 250, 333, cfg.debounceUS);
+  held->setDebounceMode(cfg.debounce);
+  bindAll(*held, cfg, other);
+  hostsim::setLevel(FIRST_PIN + 1, 0);
+  runFor(100);
+  bool ok = !InterruptButton::prepareForSleep(false);
+  hostsim::setLevel(FIRST_PIN + 1, 1);
+  runFor(100);
+  delete held;
+  for(uint32_t n : other.count) result.elsewhere += n;
+  ok = InterruptButton::prepareForSleep(false) && ok;
+  hostsim::setAsleep(true);
+  hostsim::setLevel(FIRST_PIN, 0);                                // Pressed while in light sleep
+  hostsim::setWakeCause(ESP_SLEEP_WAKEUP_GPIO, 0);
+  hostsim::setAsleep(false);
+  uint8_t replayed = InterruptButton::resumeFromSleep();
+  runFor(150);
+  hostsim::setLevel(FIRST_PIN, 1);
+  runFor(1000);
+
+  for(int held = 1; held >= 0; held--) {                          // Deep sleep, the button is set up again after waking
+    ok = InterruptButton::prepareForSleep(true) && ok;
+    delete btn;
+    hostsim::setLevel(FIRST_PIN, 0);
+    hostsim::setWakeCause(ESP_SLEEP_WAKEUP_EXT1, 1ULL << FIRST_PIN);
+    if(!held) hostsim::setLevel(FIRST_PIN, 1);                    // Let go while booting
+    btn = newButton();
+    replayed += InterruptButton::resumeFromSleep();
+    runFor(150);
+    hostsim::setLevel(FIRST_PIN, 1);
+    runFor(1000);
+  }
+  hostsim::setWakeCause(ESP_SLEEP_WAKEUP_UNDEFINED, 0);
+  double wallS = std::chrono::duration<double>(std::chrono::steady_clock::now() - wallStart).count();
+  ok = report(cfg, debounceName(cfg.debounce), "wake", result, ok && replayed == 3 && pressesOk(cfg, result, 3, false), wallS);
+  delete btn;
+  return ok;
+}
+
+// An expansion board hot-plugged over and over: its button is deleted and made again while the others are being pressed,
+// and every press on those must still arrive.  Then presses left in the synchronous queue must survive a switch to
+// asynchronous mode.  The others are set up together by beginGroup(), with a single gpio_config().
+static bool runLifecycle(const config_t &cfg, const options_t &opt) {
+  InterruptButton::setMode(cfg.mode);
+  InterruptButton::setSharedTimers(cfg.shared);
+  result_t result, plugged;                                       // The hot-plugged button's events don't count
+  std::vector<InterruptButton*> buttons;
+  for(int b = 0; b < opt.buttons; b++) {
+    InterruptButton* btn = new InterruptButton(FIRST_PIN + b, 0, GPIO_MODE_INPUT, 750, 250, 333, cfg.debounceUS);
+    btn->setDebounceMode(cfg.debounce);
+    buttons.push_back(btn);
+  }
+  hostsim::clearStats();
+  bool grouped = InterruptButton::beginGroup(buttons.data(), static_cast<uint8_t>(buttons.size())) &&
+                 hostsim::stats().gpioConfigs == 1;
+  for(InterruptButton* btn : buttons) bindAll(*btn, cfg, result);
+  const int pluggedPin = FIRST_PIN + opt.buttons;
+  InterruptButton* hot = nullptr;
+  uint32_t plugs = 0;
+
+  std::vector<edge_t> edges = syntheticWave(opt, hostsim::now() + 1000);
+  double wallS = replay(edges, opt, [&](const edge_t &e) {
+    hostsim::setLevel(FIRST_PIN + e.button, e.level);
+    if(rnd(0, 3) != 0) return;
+    if(hot == nullptr) {                                          // Plugged in, maybe mid press
+      hot = new InterruptButton(pluggedPin, 0, GPIO_MODE_INPUT, 750, 250, 333, cfg.debounceUS);
+      hot->setDebounceMode(cfg.debounce);
+      bindAll(*hot, cfg, plugged);
+      plugs++;
+    } else if(rnd(0, 1)) {
+      hostsim::setLevel(pluggedPin, !hostsim::getLevel(pluggedPin));
+    } else {
+      delete hot;                                                 // Pulled out, timers running and events still queued
+      hot = nullptr;
+    }
+  });
+  delete hot;
+  hostsim::setLevel(pluggedPin, 1);
+  for(uint32_t n : plugged.count) result.elsewhere += n;
+  bool ok = grouped && plugs > 0 && pressesOk(cfg, result, static_cast<uint32_t>(opt.presses * opt.buttons), false);
+
+  uint32_t before = result.count[Event_KeyPress];
+  if(cfg.mode == Mode_Synchronous) {                              // Pressed with no main loop running, then switched over
+    for(int p = 0; p < 3; p++) {
+      hostsim::setLevel(FIRST_PIN, 0);
+      hostsim::advanceTo(hostsim::now() + 100000);
+      hostsim::setLevel(FIRST_PIN, 1);
+      hostsim::advanceTo(hostsim::now() + 500000);
+    }
+    ok = InterruptButton::setMode(Mode_Asynchronous) && ok;
+    hostsim::waitIdle();
+    ok = ok && result.count[Event_KeyPress] == before + 3;
+    InterruptButton::setMode(cfg.mode);
+  }
+  printf("%-8s plugs %5lu                                  | ", "hotplug", static_cast<unsigned long>(plugs));
+  ok = report(cfg, debounceName(cfg.debounce), "life", result, ok, wallS);
+  for(InterruptButton* btn : buttons) delete btn;
+  return ok;
+}
+
+// Buttons switched to another debounce algorithm every few edges, so often part way through a bounce or a hold.  Every
+// press must still come out exactly once, whatever algorithm was debouncing it when it began.
+static bool runSwitchover(const config_t &cfg, const options_t &opt) {
+  static const debounceModes order[] = { Debounce_Polling, Debounce_EdgeTimestamp, Debounce_Batched, Debounce_PulseCounter };
+  InterruptButton::setMode(cfg.mode);
+  InterruptButton::setSharedTimers(cfg.shared);
+  InterruptButton::setTimerDispatch(cfg.isrTimers ? ESP_TIMER_ISR : ESP_TIMER_TASK);
+  result_t result;
+  std::vector<InterruptButton*> buttons;
+  std::vector<uint8_t> current;
+  for(int b = 0; b < opt.buttons; b++) {
+    InterruptButton* btn = new InterruptButton(FIRST_PIN + b, 0, GPIO_MODE_INPUT, 750, 250, 333, cfg.debounceUS);
+    btn->setDebounceMode(order[b % 4]);
+    bindAll(*btn, cfg, result);
+    buttons.push_back(btn);
+    current.push_back(static_cast<uint8_t>(b % 4));
+  }
+  uint32_t switches = 0;
+
+  std::vector<edge_t> edges = syntheticWave(opt, hostsim::now() + 1000);
+  double wallS = replay(edges, opt, [&](const edge_t &e) {
+    hostsim::setLevel(FIRST_PIN + e.button, e.level);
+    if(rnd(0, 4) != 0) return;
+    current[e.button] = static_cast<uint8_t>((current[e.button] + 1) % 4);
+    buttons[e.button]->setDebounceMode(order[current[e.button]]);
+    switches++;
+  });
+  bool ok = switches > 0 && pressesOk(cfg, result, static_cast<uint32_t>(opt.presses * opt.buttons), false);
+  printf("%-8s swaps %5lu                                  | ", "switch", static_cast<unsigned long>(switches));
+  ok = report(cfg, "rotating", cfg.shared ? "shared" : cfg.isrTimers ? "isr" : "own", result, ok, wallS);
+  for(InterruptButton* btn : buttons) delete btn;
+  InterruptButton::setTimerDispatch(ESP_TIMER_TASK);
+  return ok;
+}
+
+// Spins of a jog wheel, both contacts bouncing, under the normal and a very slow main loop.  The Event_Rotate records
+// (coalesced while they wait) must add up to exactly the detents turned.
+static const uint8_t ENCODER_PINS[] = { 32, 33 };
+
+static bool runEncoder(const config_t &cfg, const options_t &opt, int loopMS) {
+  InterruptButton::setMode(cfg.mode);
+  result_t result;
+  InterruptEncoder* encoder = new InterruptEncoder(ENCODER_PINS[0], ENCODER_PINS[1]);
+  encoder->bind(Event_Rotate, 0, &onEvent, &result);
+
+  static const uint8_t quadrature[2][4][2] = { { { 0, 0 }, { 1, 0 }, { 0, 1 }, { 1, 1 } },      // Clockwise, A leads B
+                                               { { 1, 0 }, { 0, 0 }, { 1, 1 }, { 0, 1 } } };    // Anticlockwise
+  std::vector<edge_t> edges;
+  s_rng = opt.seed ? opt.seed : 1;
+  int64_t t = hostsim::now() + 1000;
+  int32_t turned = 0;
+  uint32_t detents = 0;
+  for(int spin = 0; spin < opt.presses; spin++) {
+    int dir = static_cast<int>(rnd(0, 1)), clicks = static_cast<int>(rnd(1, 20));
+    uint32_t stepUS = rnd(300, 3000);                             // From a fast flick to a slow turn
+    for(int c = 0; c < clicks; c++)
+      for(const uint8_t* step : quadrature[dir]) t = addTransition(edges, t, step[0], step[1], 200) + stepUS;
+    turned += dir ? -clicks : clicks;
+    detents += static_cast<uint32_t>(clicks);
+    t += rnd(50, 500) * 1000;
+  }
+  std::stable_sort(edges.begin(), edges.end(), [](const edge_t &a, const edge_t &b) { return a.timeUS < b.timeUS; });
+
+  options_t slow = opt;
+  slow.loopMS = loopMS;
+  slow.syncBudget = 0;                                            // The slow loop is what's being measured, it takes everything
+  double wallS = replay(edges, slow, [](const edge_t &e) { hostsim::setLevel(ENCODER_PINS[e.button], e.level); });
+  InterruptButton::processSyncEvents();                           // The slow loop coming round once more, for what is still waiting
+  bool ok = result.rotation == turned && encoder->position() == turned && result.count[Event_Rotate] <= detents;
+  char label[16];
+  snprintf(label, sizeof(label), "enc%d", loopMS);
+  printf("%-8s turned  %5ld (of %5lu detents) in %4lu events | ", label, static_cast<long>(result.rotation),
+         static_cast<unsigned long>(detents), static_cast<unsigned long>(result.count[Event_Rotate]));
+  ok = report(cfg, "quad", "enc", result, ok, wallS);
+  delete encoder;
+  return ok;
+}
+
+// One long spin while the main loop is stalled: the coalesced count saturates at -INT16_MAX, and must still arrive as
+// a single rotation (not be dropped, or taken for a queued gesture) once the loop comes round.
+static bool runEncoderSaturated(const config_t &cfg, const options_t &opt) {
+  InterruptButton::setMode(cfg.mode);
+  result_t result;
+  InterruptEncoder* encoder = new InterruptEncoder(ENCODER_PINS[0], ENCODER_PINS[1]);
+  encoder->bind(Event_Rotate, 0, &onEvent, &result);
+
+  static const uint8_t anticlockwise[4][2] = { { 1, 0 }, { 0, 0 }, { 1, 1 }, { 0, 1 } };
+  const int32_t clicks = INT16_MAX + 100;
+  std::vector<edge_t> edges;
+  int64_t t = hostsim::now() + 1000;
+  for(int32_t c = 0; c < clicks; c++)
+    for(const uint8_t* step : anticlockwise) t = addTransition(edges, t, step[0], step[1], 0) + 50;
+
+  options_t stalled = opt;
+  stalled.loopMS = 100000;                                        // Only the first pass and the final one
+  stalled.syncBudget = 0;
+  double wallS = replay(edges, stalled, [](const edge_t &e) { hostsim::setLevel(ENCODER_PINS[e.button], e.level); });
+  bool ok = result.count[Event_Rotate] == 1 && result.rotation == -INT16_MAX && encoder->position() == -clicks;
+  printf("%-8s turned %6ld (of %5ld detents) in %4lu events | ", "encSat", static_cast<long>(result.rotation),
+         static_cast<long>(clicks), static_cast<unsigned long>(result.count[Event_Rotate]));
+  ok = report(cfg, "quad", "enc", result, ok, wallS);
+  delete encoder;
+  return ok;
+}
+
+#if IBTN_HISTORY_DEPTH
+// Bursts of short and long presses on one button, each one of its gestures (none the start of another).  Every burst
+// must give exactly one Event_Gesture, with that gesture's index.
+static bool runGesture(const config_t &cfg, const options_t &opt) {
+  static const char* const patterns[] = { "...", ".-", "-..", "--" };
+  InterruptButton::setMode(cfg.mode);
+  InterruptButton::setSharedTimers(cfg.shared);
+  result_t result;
+  InterruptButton* btn = new InterruptButton(FIRST_PIN, 0, GPIO_MODE_INPUT, 750, 250, 333, cfg.debounceUS);
+  btn->setDebounceMode(cfg.debounce);
+  bindAll(*btn, cfg, result);
+  btn->bind(Event_Gesture, 0, &onEvent, &result);
+  for(const char* pattern : patterns) btn->addGesture(pattern);
+
+  std::vector<edge_t> edges;
+  s_rng = opt.seed ? opt.seed : 1;
+  int64_t t = hostsim::now() + 1000;
+  uint32_t expected[4] = {};
+  for(int burst = 0; burst < opt.presses; burst++) {
+    uint32_t which = rnd(0, 3);
+    for(const char* step = patterns[which]; *step; step++) {
+      t = addTransition(edges, t, 0, 0, opt.bounceUS) + ((*step == '-') ? rnd(900, 1400) : rnd(60, 250)) * 1000;
+      t = addTransition(edges, t, 0, 1, opt.bounceUS) + rnd(60, 250) * 1000;   // Within the double-click time
+    }
+    expected[which]++;
+    t += rnd(500, 900) * 1000;
+  }
+  double wallS = replay(edges, opt, [](const edge_t &e) { hostsim::setLevel(FIRST_PIN + e.button, e.level); });
+  InterruptButton::processSyncEvents();
+  bool ok = true;
+  uint32_t matched = 0;
+  for(int g = 0; g < 4; g++) {
+    ok = ok && result.gestures[g] == expected[g];
+    matched += result.gestures[g];
+  }
+  ok = ok && result.count[Event_Gesture] == static_cast<uint32_t>(opt.presses);
+  printf("%-8s matched %5lu (of %5d bursts) in %4lu events | ", "gesture", static_cast<unsigned long>(matched), opt.presses,
+         static_cast<unsigned long>(result.count[Event_Gesture]));
+  ok = report(cfg, debounceName(cfg.debounce), "gesture", result, ok, wallS);
+  InterruptButton::clearGestures();
+  delete btn;
+  return ok;
+}
+#endif
+
+int main(int argc, char** argv) {
+  options_t opt;
+  for(int i = 1; i < argc; i++) {
+    bool hasValue = i + 1 < argc;
+    if(!strcmp(argv[i], "--presses") && hasValue)        opt.presses = atoi(argv[++i]);
+    else if(!strcmp(argv[i], "--buttons") && hasValue)   opt.buttons = std::min(std::max(atoi(argv[++i]), 1), SOC_GPIO_PIN_COUNT - FIRST_PIN);
+    else if(!strcmp(argv[i], "--seed") && hasValue)      opt.seed = static_cast<uint32_t>(strtoul(argv[++i], nullptr, 0));
+    else if(!strcmp(argv[i], "--loop-ms") && hasValue)   opt.loopMS = std::max(atoi(argv[++i]), 1);
+    else if(!strcmp(argv[i], "--bounce-us") && hasValue) opt.bounceUS = std::max(atoi(argv[++i]), 0);
+    else if(!strcmp(argv[i], "--glitches"))              opt.glitches = true;
+    else if(!strcmp(argv[i], "--wave") && hasValue)      opt.wave = argv[++i];
+    else if(!strcmp(argv[i], "--sync-budget") && hasValue) opt.syncBudget = std::max(atoi(argv[++i]), 0);
+    else {
+      fprintf(stderr, "Usage: %s [--presses N] [--buttons N] [--seed N] [--loop-ms N] [--bounce-us N] [--glitches] [--wave file.csv] [--sync-budget N]\n", argv[0]);
+      return 2;
+    }
+  }
+
+  if(opt.wave) printf("Replaying %s, loop %d ms\n", opt.wave, opt.loopMS);
+  else         printf("%d buttons x %d presses, seed %lu, loop %d ms, bounce <= %d us%s\n", opt.buttons, opt.presses,
+                      static_cast<unsigned long>(opt.seed), opt.loopMS, opt.bounceUS, opt.glitches ? ", glitches" : "");
+  if(opt.syncBudget) printf("Main loop processes at most %d sync events each time round\n", opt.syncBudget);
+  printf("%-6s %-9s %-6s %-4s %5s | %6s %6s %6s | %5s %5s %6s | %6s %6s %6s %6s | %6s %6s | %9s",
+         "mode", "debounce", "timers", "kd", "us", "keyDn", "keyUp", "press", "isr/e", "tmr/e", "ns/cb",
+         "kdMin", "kdP50", "kdP99", "kdMax", "allP50", "allP99", "events/s");
+#if IBTN_STATS
+  printf(" | %6s %6s %5s %5s %5s %6s", "edges", "false", "drops", "hwA", "hwS", "avgUS");
+#endif
+  printf("\n");
+
+#if IBTN_MAX_WORKERS > 1
+  InterruptButton::setLaneWorkers(0, IBTN_MAX_WORKERS);          // Lane 0 shared by a pool, before setMode() starts it
+#endif
+  static const modes          runModes[]    = { Mode_Asynchronous, Mode_Hybrid, Mode_Synchronous };
+  static const debounceModes  runDebounce[] = { Debounce_Polling, Debounce_EdgeTimestamp, Debounce_Batched, Debounce_PulseCounter };
+  static const uint32_t       runTimes[]    = { 4000, 8000 };
+  bool ok = true;
+  for(modes mode : runModes)
+    for(debounceModes debounce : runDebounce)
+      for(uint32_t debounceUS : runTimes)
+        for(int timers = 0; timers < 3; timers++)                 // Own, shared, own called back from the timer ISR
+          for(int fast = 0; fast < 2; fast++)
+            ok = runButtons({ mode, debounce, timers == 1, fast != 0, debounceUS, timers == 2 }, opt) && ok;
+  if(!opt.wave) {
+    for(modes mode : runModes)
+      for(uint32_t debounceUS : runTimes)
+        for(int fast = 0; fast < 2; fast++)
+          ok = runMatrix({ mode, Debounce_EdgeTimestamp, true, fast != 0, debounceUS }, opt) && ok;
+    for(modes mode : runModes)
+      for(debounceModes debounce : runDebounce)
+        ok = runChord({ mode, debounce, false, false, 8000 }, opt) && ok;
+    for(modes mode : runModes)
+      for(debounceModes debounce : runDebounce)
+        for(int multiOnly = 0; multiOnly < 2; multiOnly++)
+          ok = runClicks({ mode, debounce, false, false, 8000 }, opt, multiOnly != 0) && ok;
+    options_t tail = opt;                                         // Regression: the last holds end between two slow loops,
+    tail.seed = 7;                                                // their coalesced repeats still queued
+    tail.bounceUS = 3000;
+    for(const options_t &o : { opt, tail })
+      for(modes mode : runModes) {
+        uint32_t reference = 0;
+        config_t cfg = { mode, Debounce_Polling, false, false, 8000 };
+        ok = runRepeat(cfg, o, false, o.loopMS, reference) && ok;
+        ok = runRepeat(cfg, o, false, 3000, reference) && ok;      // Sync queue overflows, repeats are lost
+        ok = runRepeat(cfg, o, true, 3000, reference) && ok;
+      }
+    for(modes mode : runModes)
+      for(debounceModes debounce : runDebounce)
+        ok = runWake({ mode, debounce, false, false, 8000 }, opt) && ok;
+#if IBTN_HISTORY_DEPTH
+    for(modes mode : runModes)
+      for(debounceModes debounce : runDebounce)
+        ok = runGesture({ mode, debounce, false, false, 8000 }, opt) && ok;
+#endif
+    for(modes mode : runModes)
+      for(debounceModes debounce : runDebounce)
+        ok = runLifecycle({ mode, debounce, false, false, 8000 }, opt) && ok;
+    for(modes mode : runModes)
+      for(int timers = 0; timers < 3; timers++)
+        ok = runSwitchover({ mode, Debounce_Polling, timers == 1, false, 8000, timers == 2 }, opt) && ok;
+    for(modes mode : runModes) {
+      ok = runEncoder({ mode, Debounce_Polling, true, false, 0 }, opt, opt.loopMS) && ok;
+      ok = runEncoder({ mode, Debounce_Polling, true, false, 0 }, opt, 3000) && ok;
+    }
+    ok = runEncoderSaturated({ Mode_Synchronous, Debounce_Polling, true, false, 0 }, opt) && ok;
+  }
+  return ok ? 0 : 1;
+}
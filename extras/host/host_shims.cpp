@@ -0,0 +1,669 @@
+// Host implementations of the ESP-IDF / FreeRTOS functions used by InterruptButton, driven by a virtual clock.
+
+#include "host_sim.h"
+
+#include "driver/gpio.h"
+#include "esp_timer.h"
+#include "esp_sleep.h"
+#include "driver/pulse_cnt.h"
+#include "soc/soc.h"
+#include "soc/gpio_reg.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+
+// -- Simulation state -----------------------------------------------------------------------------------------------------
+// -- ----------------------------------------------------------------------------------------------------------------------
+struct esp_timer {
+  esp_timer_cb_t        callback;
+  void*                 arg;
+  esp_timer_dispatch_t  dispatch;
+  const char*           name;
+  bool                  armed;
+  int64_t               dueUS;
+  uint64_t              sequence;           // Keeps timers due at the same time in the order they were started
+};
+
+struct tskTaskControlBlock {
+  TaskFunction_t          code;
+  void*                   params;
+  std::mutex              lock;
+  std::condition_variable changed;
+  uint32_t                notifications = 0;
+  bool                    waiting = false;  // Blocked in ulTaskNotifyTake()
+  bool                    suspended = false;
+};
+
+struct pcnt_unit_t {
+  int                     count = 0;
+  int                     highLimit = 0;
+  std::vector<int>        watchPoints;
+  pcnt_watch_cb_t         onReach = nullptr;
+  void*                   ctx = nullptr;
+  bool                    running = false;
+};
+
+struct pcnt_chan_t {
+  pcnt_unit_t*            unit;
+  int                     pin;
+  pcnt_channel_edge_action_t posAction = PCNT_CHANNEL_EDGE_ACTION_HOLD;
+  pcnt_channel_edge_action_t negAction = PCNT_CHANNEL_EDGE_ACTION_HOLD;
+};
+
+struct simPin {
+  int             level = 1;                // What the pin reads, resolved from the drivers below
+  int             external = 1;             // Driven from outside by setLevel() (ie a button against a pull-up)
+  bool            configured = false;
+  bool            output = false;
+  bool            openDrain = false;        // An open-drain output only ever drives low
+  int             outLevel = 0;
+  bool            intrEnabled = false;
+  gpio_int_type_t intrType = GPIO_INTR_DISABLE;
+  gpio_isr_t      handler = nullptr;
+  void*           handlerArg = nullptr;
+  bool            pending = false;          // Raised inside a critical section, runs when it ends
+  bool            wakeup = false;           // gpio_wakeup_enable()
+};
+
+static int64_t                            s_nowUS = 0;
+static uint64_t                           s_timerSequence = 0;
+static std::vector<esp_timer*>            s_timers;
+static std::recursive_mutex               s_timerLock;
+static std::vector<tskTaskControlBlock*>  s_tasks;
+static std::mutex                         s_taskListLock;
+static simPin                             s_pins[SOC_GPIO_PIN_COUNT];
+static std::vector<std::pair<int, int>>   s_switches;            // Closed contacts between two pins
+static std::recursive_mutex               s_critical;
+static thread_local int                   t_criticalDepth = 0;
+static hostsim::counters                  s_stats = {};
+static thread_local bool                  t_inIsr = false;
+static thread_local tskTaskControlBlock*  t_currentTask = nullptr;
+static tskTaskControlBlock                s_mainTask;            // Stands in for the Arduino loop / app_main task
+static bool                               s_asleep = false;
+static std::vector<pcnt_chan_t*>          s_pcntChannels;
+static esp_sleep_wakeup_cause_t           s_wakeCause = ESP_SLEEP_WAKEUP_UNDEFINED;
+static uint64_t                           s_ext1Status = 0;
+
+
+// Runs an ISR or timer callback the way the chip would, then lets the task threads catch up
+static void runHandler(void (*handler)(void*), void* arg, bool isrContext, uint64_t &counter) {
+  auto start = std::chrono::steady_clock::now();
+  bool wasInIsr = t_inIsr;
+  t_inIsr = isrContext;
+  handler(arg);
+  t_inIsr = wasInIsr;
+  s_stats.handlerNs += std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+  counter++;
+  hostsim::waitIdle();
+}
+
+static bool taskIdle(tskTaskControlBlock* task) {             // Must hold task->lock
+  return task->waiting && (task->notifications == 0 || task->suspended);
+}
+
+static int resolveLevel(int pin) {
+  simPin &p = s_pins[pin];
+  if(p.output && !(p.openDrain && p.outLevel)) return p.outLevel;
+  for(const std::pair<int, int> &sw : s_switches) {            // Pulled low through a closed contact to a pin driving low
+    int other = (sw.first == pin) ? sw.second : (sw.second == pin) ? sw.first : -1;
+    if(other >= 0 && s_pins[other].output && s_pins[other].outLevel == 0) return 0;
+  }
+  return p.external;
+}
+
+static bool interruptActive(simPin &p, bool edge) {
+  if(!p.intrEnabled || p.handler == nullptr) return false;
+  switch(p.intrType) {
+    case GPIO_INTR_ANYEDGE:     return edge;
+    case GPIO_INTR_POSEDGE:     return edge && p.level == 1;
+    case GPIO_INTR_NEGEDGE:     return edge && p.level == 0;
+    case GPIO_INTR_LOW_LEVEL:   return p.level == 0;
+    case GPIO_INTR_HIGH_LEVEL:  return p.level == 1;
+    default:                    return false;
+  }
+}
+
+static void raiseInterrupt(int pin, bool edge) {
+  simPin &p = s_pins[pin];
+  if(s_asleep || !interruptActive(p, edge)) return;
+  if(t_criticalDepth > 0) {                                   // Interrupts are masked, it's taken once the section ends
+    p.pending = true;
+    return;
+  }
+  for(int repeats = 0; repeats < 16; repeats++) {             // A level interrupt keeps firing until its handler deals with it
+    runHandler(p.handler, p.handlerArg, true, s_stats.isrCalls);
+    if(!interruptActive(p, false)) break;
+  }
+}
+
+struct pcntEvent {
+  pcnt_unit_t*            unit;
+  pcnt_watch_event_data_t data;
+};
+
+static void pcntWatchHandler(void* arg) {
+  pcntEvent* evt = static_cast<pcntEvent*>(arg);
+  evt->unit->onReach(evt->unit, &evt->data, evt->unit->ctx);
+}
+
+static void countEdge(int pin) {                              // PCNT channels on the pin, counting in hardware (no CPU time)
+  for(size_t c = 0; c < s_pcntChannels.size(); c++) {
+    pcnt_chan_t* chan = s_pcntChannels[c];
+    pcnt_unit_t* unit = chan->unit;
+    if(chan->pin != pin || !unit->running) continue;
+    pcnt_channel_edge_action_t action = s_pins[pin].level ? chan->posAction : chan->negAction;
+    if(action == PCNT_CHANNEL_EDGE_ACTION_HOLD) continue;
+    unit->count += (action == PCNT_CHANNEL_EDGE_ACTION_INCREASE) ? 1 : -1;
+    if(unit->count >= unit->highLimit) unit->count = 0;
+    bool watched = std::find(unit->watchPoints.begin(), unit->watchPoints.end(), unit->count) != unit->watchPoints.end();
+    if(watched && unit->onReach != nullptr && !s_asleep) {
+      pcntEvent evt = { unit, { unit->count } };
+      runHandler(&pcntWatchHandler, &evt, true, s_stats.isrCalls);
+    }
+  }
+}
+
+static void updatePins(void) {                                // Re-resolve every pin after anything that drives them changes
+  for(int pin = 0; pin < SOC_GPIO_PIN_COUNT; pin++) {
+    int level = resolveLevel(pin);
+    if(level == s_pins[pin].level) continue;
+    s_pins[pin].level = level;
+    countEdge(pin);
+    raiseInterrupt(pin, true);
+  }
+}
+
+
+// -- Simulation control ---------------------------------------------------------------------------------------------------
+// -- ----------------------------------------------------------------------------------------------------------------------
+namespace hostsim {
+
+int64_t now(void) {
+  return s_nowUS;
+}
+
+void advanceTo(int64_t timeUS) {
+  while(1) {
+    esp_timer* next = nullptr;
+    {
+      std::lock_guard<std::recursive_mutex> guard(s_timerLock);
+      for(esp_timer* tmr : s_timers) {
+        if(!tmr->armed || tmr->dueUS > timeUS) continue;
+        if(next == nullptr || tmr->dueUS < next->dueUS || (tmr->dueUS == next->dueUS && tmr->sequence < next->sequence)) next = tmr;
+      }
+      if(next == nullptr) break;
+      if(next->dueUS > s_nowUS) s_nowUS = next->dueUS;
+      next->armed = false;
+    }
+    runHandler(next->callback, next->arg, next->dispatch == ESP_TIMER_ISR, s_stats.timerCalls);
+  }
+  if(timeUS > s_nowUS) s_nowUS = timeUS;
+}
+
+void setLevel(int pin, int level) {
+  simPin &p = s_pins[pin];
+  level = level ? 1 : 0;
+  if(p.external == level) return;
+  p.external = level;
+  s_stats.edges++;
+  updatePins();
+}
+
+void setSwitch(int pinA, int pinB, bool closed) {
+  std::pair<int, int> sw(pinA, pinB);
+  auto found = std::find(s_switches.begin(), s_switches.end(), sw);
+  if(closed == (found != s_switches.end())) return;
+  if(closed) s_switches.push_back(sw); else s_switches.erase(found);
+  s_stats.edges++;
+  updatePins();
+}
+
+int getLevel(int pin) {
+  return s_pins[pin].level;
+}
+
+void setAsleep(bool asleep) {
+  s_asleep = asleep;
+  if(asleep) return;
+  for(int pin = 0; pin < SOC_GPIO_PIN_COUNT; pin++) raiseInterrupt(pin, false);   // Any level interrupt is taken on waking
+}
+
+void setWakeCause(int cause, uint64_t ext1Mask) {
+  s_wakeCause = static_cast<esp_sleep_wakeup_cause_t>(cause);
+  s_ext1Status = ext1Mask;
+}
+
+void waitIdle(void) {
+  std::vector<tskTaskControlBlock*> tasks;
+  {
+    std::lock_guard<std::mutex> guard(s_taskListLock);
+    tasks = s_tasks;
+  }
+  for(tskTaskControlBlock* task : tasks) {
+    if(task == t_currentTask) continue;                       // A task can't wait for itself
+    std::unique_lock<std::mutex> guard(task->lock);
+    task->changed.wait(guard, [task]{ return taskIdle(task); });
+  }
+}
+
+counters& stats(void) {
+  return s_stats;
+}
+
+void clearStats(void) {
+  s_stats = {};
+}
+
+} // namespace hostsim
+
+
+// -- esp_timer ------------------------------------------------------------------------------------------------------------
+// -- ----------------------------------------------------------------------------------------------------------------------
+esp_err_t esp_timer_create(const esp_timer_create_args_t* create_args, esp_timer_handle_t* out_handle) {
+  if(create_args == nullptr || create_args->callback == nullptr || out_handle == nullptr) return ESP_ERR_INVALID_ARG;
+  std::lock_guard<std::recursive_mutex> guard(s_timerLock);
+  esp_timer* tmr = new esp_timer { create_args->callback, create_args->arg, create_args->dispatch_method, create_args->name, false, 0, 0 };
+  s_timers.push_back(tmr);
+  s_stats.timerCreates++;
+  *out_handle = tmr;
+  return ESP_OK;
+}
+
+esp_err_t esp_timer_start_once(esp_timer_handle_t timer, uint64_t timeout_us) {
+  std::lock_guard<std::recursive_mutex> guard(s_timerLock);
+  if(timer == nullptr)  return ESP_ERR_INVALID_ARG;
+  if(timer->armed)      return ESP_ERR_INVALID_STATE;
+  timer->armed = true;
+  timer->dueUS = s_nowUS + static_cast<int64_t>(timeout_us);
+  timer->sequence = s_timerSequence++;
+  s_stats.timerStarts++;
+  return ESP_OK;
+}
+
+esp_err_t esp_timer_stop(esp_timer_handle_t timer) {
+  std::lock_guard<std::recursive_mutex> guard(s_timerLock);
+  if(timer == nullptr)  return ESP_ERR_INVALID_ARG;
+  if(!timer->armed)     return ESP_ERR_INVALID_STATE;
+  timer->armed = false;
+  return ESP_OK;
+}
+
+esp_err_t esp_timer_delete(esp_timer_handle_t timer) {
+  std::lock_guard<std::recursive_mutex> guard(s_timerLock);
+  if(timer == nullptr)  return ESP_ERR_INVALID_ARG;
+  if(timer->armed)      return ESP_ERR_INVALID_STATE;
+  s_timers.erase(std::remove(s_timers.begin(), s_timers.end(), timer), s_timers.end());
+  delete timer;
+  s_stats.timerDeletes++;
+  return ESP_OK;
+}
+
+int64_t esp_timer_get_time(void) {
+  return s_nowUS;
+}
+
+
+// -- GPIO driver ----------------------------------------------------------------------------------------------------------
+// -- ----------------------------------------------------------------------------------------------------------------------
+esp_err_t gpio_config(const gpio_config_t* pGPIOConfig) {
+  if(pGPIOConfig == nullptr) return ESP_ERR_INVALID_ARG;
+  s_stats.gpioConfigs++;
+  for(int pin = 0; pin < SOC_GPIO_PIN_COUNT; pin++) {
+    if(!(pGPIOConfig->pin_bit_mask & BIT64(pin))) continue;
+    simPin &p = s_pins[pin];
+    if(!p.configured) p.external = (pGPIOConfig->pull_down_en == GPIO_PULLDOWN_ENABLE) ? 0 : 1;   // Idle level from the pulls
+    p.configured = true;
+    p.output = (pGPIOConfig->mode & GPIO_MODE_OUTPUT) != 0;
+    p.openDrain = (pGPIOConfig->mode & 4) != 0;
+    p.intrType = pGPIOConfig->intr_type;
+    p.intrEnabled = pGPIOConfig->intr_type != GPIO_INTR_DISABLE;
+  }
+  updatePins();
+  return ESP_OK;
+}
+
+esp_err_t gpio_reset_pin(gpio_num_t gpio_num) {
+  if(!GPIO_IS_VALID_GPIO(gpio_num)) return ESP_ERR_INVALID_ARG;
+  simPin &p = s_pins[gpio_num];
+  p.output = false;
+  p.intrEnabled = false;
+  p.intrType = GPIO_INTR_DISABLE;
+  updatePins();
+  return ESP_OK;
+}
+
+esp_err_t gpio_install_isr_service(int intr_alloc_flags) {
+  (void)intr_alloc_flags;
+  static bool installed = false;
+  if(installed) return ESP_ERR_INVALID_STATE;
+  installed = true;
+  return ESP_OK;
+}
+
+esp_err_t gpio_isr_handler_add(gpio_num_t gpio_num, gpio_isr_t isr_handler, void* args) {
+  if(!GPIO_IS_VALID_GPIO(gpio_num)) return ESP_ERR_INVALID_ARG;
+  s_pins[gpio_num].handler = isr_handler;
+  s_pins[gpio_num].handlerArg = args;
+  return ESP_OK;
+}
+
+esp_err_t gpio_isr_handler_remove(gpio_num_t gpio_num) {
+  if(!GPIO_IS_VALID_GPIO(gpio_num)) return ESP_ERR_INVALID_ARG;
+  s_pins[gpio_num].handler = nullptr;
+  s_pins[gpio_num].handlerArg = nullptr;
+  return ESP_OK;
+}
+
+esp_err_t gpio_set_intr_type(gpio_num_t gpio_num, gpio_int_type_t intr_type) {
+  if(!GPIO_IS_VALID_GPIO(gpio_num)) return ESP_ERR_INVALID_ARG;
+  s_pins[gpio_num].intrType = intr_type;
+  raiseInterrupt(gpio_num, false);
+  return ESP_OK;
+}
+
+esp_err_t gpio_intr_enable(gpio_num_t gpio_num) {
+  if(!GPIO_IS_VALID_GPIO(gpio_num)) return ESP_ERR_INVALID_ARG;
+  s_pins[gpio_num].intrEnabled = true;
+  raiseInterrupt(gpio_num, false);                            // Only a level interrupt can be raised by enabling it
+  return ESP_OK;
+}
+
+esp_err_t gpio_intr_disable(gpio_num_t gpio_num) {
+  if(!GPIO_IS_VALID_GPIO(gpio_num)) return ESP_ERR_INVALID_ARG;
+  s_pins[gpio_num].intrEnabled = false;
+  return ESP_OK;
+}
+
+int gpio_get_level(gpio_num_t gpio_num) {
+  if(!GPIO_IS_VALID_GPIO(gpio_num)) return 0;
+  return s_pins[gpio_num].level;
+}
+
+esp_err_t gpio_set_level(gpio_num_t gpio_num, uint32_t level) {
+  if(!GPIO_IS_VALID_GPIO(gpio_num)) return ESP_ERR_INVALID_ARG;
+  s_pins[gpio_num].outLevel = level ? 1 : 0;
+  updatePins();
+  return ESP_OK;
+}
+
+
+esp_err_t gpio_set_pull_mode(gpio_num_t gpio_num, gpio_pull_mode_t pull) {
+  if(!GPIO_IS_VALID_GPIO(gpio_num)) return ESP_ERR_INVALID_ARG;
+  (void)pull;                                                 // The idle level was set by gpio_config()
+  return ESP_OK;
+}
+
+esp_err_t gpio_wakeup_enable(gpio_num_t gpio_num, gpio_int_type_t intr_type) {
+  if(!GPIO_IS_VALID_GPIO(gpio_num)) return ESP_ERR_INVALID_ARG;
+  if(intr_type != GPIO_INTR_LOW_LEVEL && intr_type != GPIO_INTR_HIGH_LEVEL) return ESP_ERR_INVALID_ARG;
+  s_pins[gpio_num].wakeup = true;
+  s_pins[gpio_num].intrType = intr_type;                      // As on the chip, the pin's interrupt type is changed too
+  return ESP_OK;
+}
+
+esp_err_t gpio_wakeup_disable(gpio_num_t gpio_num) {
+  if(!GPIO_IS_VALID_GPIO(gpio_num)) return ESP_ERR_INVALID_ARG;
+  s_pins[gpio_num].wakeup = false;
+  return ESP_OK;
+}
+
+
+// -- Pulse counter --------------------------------------------------------------------------------------------------------
+// -- ----------------------------------------------------------------------------------------------------------------------
+esp_err_t pcnt_new_unit(const pcnt_unit_config_t* config, pcnt_unit_handle_t* ret_unit) {
+  if(config == nullptr || ret_unit == nullptr || config->low_limit >= 0 || config->high_limit <= 0) return ESP_ERR_INVALID_ARG;
+  pcnt_unit_t* unit = new pcnt_unit_t;
+  unit->highLimit = config->high_limit;
+  *ret_unit = unit;
+  return ESP_OK;
+}
+
+esp_err_t pcnt_del_unit(pcnt_unit_handle_t unit) {
+  if(unit == nullptr) return ESP_ERR_INVALID_ARG;
+  delete unit;
+  return ESP_OK;
+}
+
+esp_err_t pcnt_unit_set_glitch_filter(pcnt_unit_handle_t unit, const pcnt_glitch_filter_config_t* config) {
+  return (unit != nullptr && config != nullptr) ? ESP_OK : ESP_ERR_INVALID_ARG;
+}
+
+esp_err_t pcnt_new_channel(pcnt_unit_handle_t unit, const pcnt_chan_config_t* config, pcnt_channel_handle_t* ret_chan) {
+  if(unit == nullptr || config == nullptr || ret_chan == nullptr || !GPIO_IS_VALID_GPIO(config->edge_gpio_num)) return ESP_ERR_INVALID_ARG;
+  pcnt_chan_t* chan = new pcnt_chan_t { unit, config->edge_gpio_num };
+  s_pcntChannels.push_back(chan);
+  *ret_chan = chan;
+  return ESP_OK;
+}
+
+esp_err_t pcnt_del_channel(pcnt_channel_handle_t chan) {
+  if(chan == nullptr) return ESP_ERR_INVALID_ARG;
+  s_pcntChannels.erase(std::remove(s_pcntChannels.begin(), s_pcntChannels.end(), chan), s_pcntChannels.end());
+  delete chan;
+  return ESP_OK;
+}
+
+esp_err_t pcnt_channel_set_edge_action(pcnt_channel_handle_t chan, pcnt_channel_edge_action_t pos_act, pcnt_channel_edge_action_t neg_act) {
+  if(chan == nullptr) return ESP_ERR_INVALID_ARG;
+  chan->posAction = pos_act;
+  chan->negAction = neg_act;
+  return ESP_OK;
+}
+
+esp_err_t pcnt_unit_add_watch_point(pcnt_unit_handle_t unit, int watch_point) {
+  if(unit == nullptr) return ESP_ERR_INVALID_ARG;
+  unit->watchPoints.push_back(watch_point);
+  return ESP_OK;
+}
+
+esp_err_t pcnt_unit_register_event_callbacks(pcnt_unit_handle_t unit, const pcnt_event_callbacks_t* cbs, void* user_data) {
+  if(unit == nullptr || cbs == nullptr) return ESP_ERR_INVALID_ARG;
+  unit->onReach = cbs->on_reach;
+  unit->ctx = user_data;
+  return ESP_OK;
+}
+
+esp_err_t pcnt_unit_enable(pcnt_unit_handle_t unit)  { return unit ? ESP_OK : ESP_ERR_INVALID_ARG; }
+esp_err_t pcnt_unit_disable(pcnt_unit_handle_t unit) { return unit ? ESP_OK : ESP_ERR_INVALID_ARG; }
+
+esp_err_t pcnt_unit_start(pcnt_unit_handle_t unit) {
+  if(unit == nullptr) return ESP_ERR_INVALID_ARG;
+  unit->running = true;
+  return ESP_OK;
+}
+
+esp_err_t pcnt_unit_stop(pcnt_unit_handle_t unit) {
+  if(unit == nullptr) return ESP_ERR_INVALID_ARG;
+  unit->running = false;
+  return ESP_OK;
+}
+
+esp_err_t pcnt_unit_clear_count(pcnt_unit_handle_t unit) {
+  if(unit == nullptr) return ESP_ERR_INVALID_ARG;
+  unit->count = 0;
+  return ESP_OK;
+}
+
+esp_err_t pcnt_unit_get_count(pcnt_unit_handle_t unit, int* value) {
+  if(unit == nullptr || value == nullptr) return ESP_ERR_INVALID_ARG;
+  *value = unit->count;
+  return ESP_OK;
+}
+
+
+// -- Sleep ----------------------------------------------------------------------------------------------------------------
+// -- ----------------------------------------------------------------------------------------------------------------------
+esp_err_t esp_sleep_enable_gpio_wakeup(void) {
+  return ESP_OK;
+}
+
+esp_err_t esp_sleep_enable_ext1_wakeup(uint64_t io_mask, esp_sleep_ext1_wakeup_mode_t level_mode) {
+  (void)level_mode;
+  for(int pin = 0; pin < SOC_GPIO_PIN_COUNT; pin++) {
+    if((io_mask & BIT64(pin)) && !esp_sleep_is_valid_wakeup_gpio(static_cast<gpio_num_t>(pin))) return ESP_ERR_INVALID_ARG;
+  }
+  return ESP_OK;
+}
+
+esp_err_t esp_sleep_pd_config(esp_sleep_pd_domain_t domain, esp_sleep_pd_option_t option) {
+  (void)domain; (void)option;
+  return ESP_OK;
+}
+
+bool esp_sleep_is_valid_wakeup_gpio(gpio_num_t gpio_num) {       // The ESP32's RTC GPIOs
+  static const uint64_t rtcPins = BIT64(0) | BIT64(2) | BIT64(4) | (0xFULL << 12) | (0x3ULL << 25) | (0xFULL << 32) | (0xFULL << 36);
+  return GPIO_IS_VALID_GPIO(gpio_num) && (rtcPins & BIT64(gpio_num));
+}
+
+esp_sleep_wakeup_cause_t esp_sleep_get_wakeup_cause(void) {
+  return s_wakeCause;
+}
+
+uint64_t esp_sleep_get_ext1_wakeup_status(void) {
+  return (s_wakeCause == ESP_SLEEP_WAKEUP_EXT1) ? s_ext1Status : 0;
+}
+
+
+// -- GPIO registers -------------------------------------------------------------------------------------------------------
+// -- ----------------------------------------------------------------------------------------------------------------------
+uint32_t hostRegRead(uint32_t reg) {
+  int first = (reg == GPIO_IN_REG) ? 0 : (reg == GPIO_IN1_REG) ? 32 : -1;
+  if(first < 0) return 0;
+  uint32_t value = 0;
+  for(int pin = first; pin < first + 32 && pin < SOC_GPIO_PIN_COUNT; pin++) {
+    if(s_pins[pin].level) value |= 1UL << (pin - first);
+  }
+  return value;
+}
+
+void hostRegWrite(uint32_t reg, uint32_t value) {
+  int first = (reg == GPIO_OUT_W1TS_REG || reg == GPIO_OUT_W1TC_REG) ? 0 :
+              (reg == GPIO_OUT1_W1TS_REG || reg == GPIO_OUT1_W1TC_REG) ? 32 : -1;
+  if(first < 0) return;
+  int level = (reg == GPIO_OUT_W1TS_REG || reg == GPIO_OUT1_W1TS_REG) ? 1 : 0;
+  for(int pin = first; pin < first + 32 && pin < SOC_GPIO_PIN_COUNT; pin++) {
+    if(value & (1UL << (pin - first))) s_pins[pin].outLevel = level;
+  }
+  updatePins();
+}
+
+
+// -- FreeRTOS -------------------------------------------------------------------------------------------------------------
+// -- ----------------------------------------------------------------------------------------------------------------------
+void hostEnterCritical(portMUX_TYPE* mux) {
+  (void)mux;
+  s_critical.lock();
+  t_criticalDepth++;
+}
+
+void hostExitCritical(portMUX_TYPE* mux) {
+  (void)mux;
+  t_criticalDepth--;
+  s_critical.unlock();
+  if(t_criticalDepth > 0) return;
+  for(int pin = 0; pin < SOC_GPIO_PIN_COUNT; pin++) {         // Take any interrupts held off by the section
+    if(!s_pins[pin].pending) continue;
+    s_pins[pin].pending = false;
+    if(s_pins[pin].intrEnabled && s_pins[pin].handler != nullptr) runHandler(s_pins[pin].handler, s_pins[pin].handlerArg, true, s_stats.isrCalls);
+  }
+}
+
+BaseType_t xPortInIsrContext(void) {
+  return t_inIsr ? pdTRUE : pdFALSE;
+}
+
+void hostYieldFromISR(void) {
+}
+
+BaseType_t xTaskCreatePinnedToCore(TaskFunction_t pvTaskCode, const char* pcName, uint32_t usStackDepth, void* pvParameters,
+                                   UBaseType_t uxPriority, TaskHandle_t* pvCreatedTask, BaseType_t xCoreID) {
+  (void)pcName; (void)usStackDepth; (void)uxPriority; (void)xCoreID;
+  tskTaskControlBlock* task = new tskTaskControlBlock();      // Never freed, tasks live for the whole run
+  task->code = pvTaskCode;
+  task->params = pvParameters;
+  {
+    std::lock_guard<std::mutex> guard(s_taskListLock);
+    s_tasks.push_back(task);
+  }
+  if(pvCreatedTask != nullptr) *pvCreatedTask = task;
+  std::thread([task]{
+    t_currentTask = task;
+    task->code(task->params);
+  }).detach();
+  hostsim::waitIdle();                                        // Let it run up to its first wait
+  return pdPASS;
+}
+
+void vTaskDelete(TaskHandle_t xTaskToDelete) {
+  if(xTaskToDelete == nullptr || xTaskToDelete == t_currentTask) {
+    std::lock_guard<std::mutex> guard(t_currentTask->lock);   // Park the thread forever, it counts as idle
+    t_currentTask->waiting = true;
+    t_currentTask->suspended = true;
+    t_currentTask->changed.notify_all();
+  }
+}
+
+void vTaskSuspend(TaskHandle_t xTaskToSuspend) {
+  tskTaskControlBlock* task = (xTaskToSuspend != nullptr) ? xTaskToSuspend : t_currentTask;
+  if(task == nullptr) return;
+  std::lock_guard<std::mutex> guard(task->lock);
+  task->suspended = true;
+  task->changed.notify_all();
+}
+
+void vTaskResume(TaskHandle_t xTaskToResume) {
+  if(xTaskToResume == nullptr) return;
+  std::lock_guard<std::mutex> guard(xTaskToResume->lock);
+  xTaskToResume->suspended = false;
+  xTaskToResume->changed.notify_all();
+}
+
+void vTaskPrioritySet(TaskHandle_t xTask, UBaseType_t uxNewPriority) {
+  (void)xTask; (void)uxNewPriority;                           // Host threads aren't prioritised
+}
+
+void vTaskDelay(TickType_t xTicksToDelay) {
+  std::this_thread::sleep_for(std::chrono::milliseconds(xTicksToDelay * portTICK_PERIOD_MS));
+}
+
+TaskHandle_t xTaskGetCurrentTaskHandle(void) {
+  return (t_currentTask != nullptr) ? t_currentTask : &s_mainTask;
+}
+
+uint32_t ulTaskNotifyTake(BaseType_t xClearCountOnExit, TickType_t xTicksToWait) {
+  tskTaskControlBlock* task = t_currentTask;
+  if(task == nullptr) return 0;                               // Not supported from the main thread
+  std::unique_lock<std::mutex> guard(task->lock);
+  task->waiting = true;
+  task->changed.notify_all();
+  if(xTicksToWait == portMAX_DELAY) {
+    task->changed.wait(guard, [task]{ return task->notifications > 0 && !task->suspended; });
+  } else {
+    task->changed.wait_for(guard, std::chrono::milliseconds(xTicksToWait * portTICK_PERIOD_MS),
+                           [task]{ return task->notifications > 0 && !task->suspended; });
+  }
+  task->waiting = false;
+  uint32_t count = task->notifications;
+  if(count > 0) task->notifications = xClearCountOnExit ? 0 : count - 1;
+  return count;
+}
+
+BaseType_t xTaskNotifyGive(TaskHandle_t xTaskToNotify) {
+  if(xTaskToNotify == nullptr) return pdFAIL;
+  std::lock_guard<std::mutex> guard(xTaskToNotify->lock);
+  xTaskToNotify->notifications++;
+  xTaskToNotify->changed.notify_all();
+  return pdPASS;
+}
+
+void vTaskNotifyGiveFromISR(TaskHandle_t xTaskToNotify, BaseType_t* pxHigherPriorityTaskWoken) {
+  xTaskNotifyGive(xTaskToNotify);
+  if(pxHigherPriorityTaskWoken != nullptr) *pxHigherPriorityTaskWoken = pdTRUE;
+}
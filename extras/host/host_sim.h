@@ -0,0 +1,42 @@
+// Control interface for the simulated ESP32 used by the host benchmark (see host_shims.cpp).
+//
+// Time is virtual: it only moves when advanceTo() is called, and expired esp_timers are run in due order as it does.
+// GPIO ISRs run immediately when setLevel() or setSwitch() changes a pin, or once the critical section they land in ends.
+// While asleep (setAsleep()) pin changes raise no ISR, as the CPU isn't running to take them.
+// After every ISR or timer callback the simulation waits for the RTOS task threads (ie the async servicer) to go idle, so
+// callbacks see the same virtual time as the event.
+
+#ifndef HOST_SIM_H_
+#define HOST_SIM_H_
+
+#include <stdint.h>
+
+namespace hostsim {
+
+struct counters {
+  uint64_t  edges;              // Pin level changes driven by the simulation
+  uint64_t  isrCalls;           // GPIO ISR handler invocations
+  uint64_t  timerCalls;         // esp_timer callback invocations
+  uint64_t  timerStarts;        // esp_timer_start_once() calls
+  uint64_t  timerCreates;       // esp_timer_create() calls
+  uint64_t  timerDeletes;       // esp_timer_delete() calls
+  uint64_t  handlerNs;          // Host time spent inside ISR and timer callbacks
+  uint64_t  gpioConfigs;        // gpio_config() calls
+};
+
+int64_t   now(void);                        // Current virtual time (us)
+void      advanceTo(int64_t timeUS);        // Move time forward, running any timers that expire on the way
+void      setLevel(int pin, int level);     // Drive an input pin, raising its ISR if the level changes
+void      setSwitch(int pinA, int pinB,     // Open or close a contact between two pins (ie a keypad key between a row and column)
+                    bool closed);
+int       getLevel(int pin);
+void      setAsleep(bool asleep);           // Light or deep sleep: edges are missed until woken, level interrupts are taken then
+void      setWakeCause(int cause,           // What esp_sleep_get_wakeup_cause() (and the ext1 status) report from now on
+                       uint64_t ext1Mask);
+void      waitIdle(void);                   // Block until every simulated task is waiting for work
+counters& stats(void);
+void      clearStats(void);
+
+} // namespace hostsim
+
+#endif // HOST_SIM_H_
@@ -0,0 +1,12 @@
+// Host build shim: RTC pulls, only used while in deep sleep so they do nothing here.
+#ifndef HOST_DRIVER_RTC_IO_H_
+#define HOST_DRIVER_RTC_IO_H_
+
+#include "driver/gpio.h"
+
+static inline esp_err_t rtc_gpio_pullup_en(gpio_num_t gpio_num)    { (void)gpio_num; return ESP_OK; }
+static inline esp_err_t rtc_gpio_pullup_dis(gpio_num_t gpio_num)   { (void)gpio_num; return ESP_OK; }
+static inline esp_err_t rtc_gpio_pulldown_en(gpio_num_t gpio_num)  { (void)gpio_num; return ESP_OK; }
+static inline esp_err_t rtc_gpio_pulldown_dis(gpio_num_t gpio_num) { (void)gpio_num; return ESP_OK; }
+
+#endif // HOST_DRIVER_RTC_IO_H_
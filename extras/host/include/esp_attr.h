@@ -0,0 +1,8 @@
+// Host build shim: section attributes have no meaning on the host.
+#ifndef HOST_ESP_ATTR_H_
+#define HOST_ESP_ATTR_H_
+
+#define IRAM_ATTR
+#define DRAM_ATTR
+
+#endif // HOST_ESP_ATTR_H_
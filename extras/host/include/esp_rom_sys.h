@@ -0,0 +1,9 @@
+// Host build shim: busy waits take no virtual time.
+#ifndef HOST_ESP_ROM_SYS_H_
+#define HOST_ESP_ROM_SYS_H_
+
+#include <stdint.h>
+
+static inline void esp_rom_delay_us(uint32_t us) { (void)us; }
+
+#endif // HOST_ESP_ROM_SYS_H_
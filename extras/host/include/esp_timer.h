@@ -0,0 +1,33 @@
+// Host build shim: esp_timer driven by the simulated clock in host_shims.cpp.
+#ifndef HOST_ESP_TIMER_H_
+#define HOST_ESP_TIMER_H_
+
+#include <stdint.h>
+#include "esp_err.h"
+
+#define CONFIG_ESP_TIMER_SUPPORTS_ISR_DISPATCH_METHOD 1     // As on targets where esp_timer can call back from its ISR
+
+typedef struct esp_timer* esp_timer_handle_t;
+typedef void (*esp_timer_cb_t)(void* arg);
+
+typedef enum {
+  ESP_TIMER_TASK,
+  ESP_TIMER_ISR,
+  ESP_TIMER_MAX
+} esp_timer_dispatch_t;
+
+typedef struct {
+  esp_timer_cb_t        callback;
+  void*                 arg;
+  esp_timer_dispatch_t  dispatch_method;
+  const char*           name;
+  bool                  skip_unhandled_events;
+} esp_timer_create_args_t;
+
+esp_err_t esp_timer_create(const esp_timer_create_args_t* create_args, esp_timer_handle_t* out_handle);
+esp_err_t esp_timer_start_once(esp_timer_handle_t timer, uint64_t timeout_us);
+esp_err_t esp_timer_stop(esp_timer_handle_t timer);
+esp_err_t esp_timer_delete(esp_timer_handle_t timer);
+int64_t   esp_timer_get_time(void);
+
+#endif // HOST_ESP_TIMER_H_
@@ -0,0 +1,42 @@
+// Host build shim: the parts of FreeRTOS (and the ESP port layer) used by InterruptButton.
+#ifndef HOST_FREERTOS_H_
+#define HOST_FREERTOS_H_
+
+#include <stdint.h>
+
+typedef uint32_t  TickType_t;
+typedef int       BaseType_t;
+typedef unsigned  UBaseType_t;
+
+#define pdFALSE             0
+#define pdTRUE              1
+#define pdPASS              pdTRUE
+#define pdFAIL              pdFALSE
+#define configTICK_RATE_HZ  1000
+#define portMAX_DELAY       ((TickType_t)0xffffffffUL)
+#define portTICK_PERIOD_MS  ((TickType_t)1000 / configTICK_RATE_HZ)
+#define pdMS_TO_TICKS(ms)   ((TickType_t)(((TickType_t)(ms) * configTICK_RATE_HZ) / 1000))
+#define tskNO_AFFINITY      ((BaseType_t)0x7FFFFFFF)
+#define portNUM_PROCESSORS  2
+
+typedef struct {
+  int reserved;
+} portMUX_TYPE;
+#define portMUX_INITIALIZER_UNLOCKED  { 0 }
+
+// All critical sections share one recursive lock on the host, which is enough to serialise the simulated
+// ISR / timer context against the servicer task threads.
+void        hostEnterCritical(portMUX_TYPE* mux);
+void        hostExitCritical(portMUX_TYPE* mux);
+BaseType_t  xPortInIsrContext(void);
+void        hostYieldFromISR(void);
+
+#define portENTER_CRITICAL(mux)         hostEnterCritical(mux)
+#define portEXIT_CRITICAL(mux)          hostExitCritical(mux)
+#define portENTER_CRITICAL_ISR(mux)     hostEnterCritical(mux)
+#define portEXIT_CRITICAL_ISR(mux)      hostExitCritical(mux)
+#define portENTER_CRITICAL_SAFE(mux)    hostEnterCritical(mux)
+#define portEXIT_CRITICAL_SAFE(mux)     hostExitCritical(mux)
+#define portYIELD_FROM_ISR(...)         hostYieldFromISR()
+
+#endif // HOST_FREERTOS_H_
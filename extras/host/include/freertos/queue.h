@@ -0,0 +1,7 @@
+// Host build shim: no FreeRTOS queue functions are needed by InterruptButton.
+#ifndef HOST_FREERTOS_QUEUE_H_
+#define HOST_FREERTOS_QUEUE_H_
+
+#include "FreeRTOS.h"
+
+#endif // HOST_FREERTOS_QUEUE_H_
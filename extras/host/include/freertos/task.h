@@ -0,0 +1,22 @@
+// Host build shim: FreeRTOS tasks run as threads, see host_shims.cpp.
+#ifndef HOST_FREERTOS_TASK_H_
+#define HOST_FREERTOS_TASK_H_
+
+#include "FreeRTOS.h"
+
+typedef struct tskTaskControlBlock* TaskHandle_t;
+typedef void (*TaskFunction_t)(void* pvParameters);
+
+BaseType_t    xTaskCreatePinnedToCore(TaskFunction_t pvTaskCode, const char* pcName, uint32_t usStackDepth, void* pvParameters,
+                                      UBaseType_t uxPriority, TaskHandle_t* pvCreatedTask, BaseType_t xCoreID);
+void          vTaskDelete(TaskHandle_t xTaskToDelete);
+void          vTaskSuspend(TaskHandle_t xTaskToSuspend);
+void          vTaskResume(TaskHandle_t xTaskToResume);
+void          vTaskPrioritySet(TaskHandle_t xTask, UBaseType_t uxNewPriority);
+void          vTaskDelay(TickType_t xTicksToDelay);
+TaskHandle_t  xTaskGetCurrentTaskHandle(void);
+uint32_t      ulTaskNotifyTake(BaseType_t xClearCountOnExit, TickType_t xTicksToWait);
+BaseType_t    xTaskNotifyGive(TaskHandle_t xTaskToNotify);
+void          vTaskNotifyGiveFromISR(TaskHandle_t xTaskToNotify, BaseType_t* pxHigherPriorityTaskWoken);
+
+#endif // HOST_FREERTOS_TASK_H_
@@ -0,0 +1,12 @@
+// Host build shim: the GPIO registers used by InterruptButton (addresses as on the ESP32).
+#ifndef HOST_SOC_GPIO_REG_H_
+#define HOST_SOC_GPIO_REG_H_
+
+#define GPIO_OUT_W1TS_REG       0x3FF44008
+#define GPIO_OUT_W1TC_REG       0x3FF4400C
+#define GPIO_OUT1_W1TS_REG      0x3FF44014
+#define GPIO_OUT1_W1TC_REG      0x3FF44018
+#define GPIO_IN_REG             0x3FF4403C
+#define GPIO_IN1_REG            0x3FF44040
+
+#endif // HOST_SOC_GPIO_REG_H_
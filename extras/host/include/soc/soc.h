@@ -0,0 +1,13 @@
+// Host build shim: register access goes to the simulated GPIO matrix in host_shims.cpp.
+#ifndef HOST_SOC_SOC_H_
+#define HOST_SOC_SOC_H_
+
+#include <stdint.h>
+
+uint32_t  hostRegRead(uint32_t reg);
+void      hostRegWrite(uint32_t reg, uint32_t value);
+
+#define REG_READ(reg)           hostRegRead(reg)
+#define REG_WRITE(reg, value)   hostRegWrite((reg), (value))
+
+#endif // HOST_SOC_SOC_H_
@@ -0,0 +1,9 @@
+// Host build shim: the simulated target has no optional peripherals (glitch filters etc).
+#ifndef HOST_SOC_CAPS_H_
+#define HOST_SOC_CAPS_H_
+
+#define SOC_GPIO_PIN_COUNT      40
+#define SOC_PM_SUPPORT_EXT1_WAKEUP  1
+#define SOC_PCNT_SUPPORTED      1
+
+#endif // HOST_SOC_CAPS_H_